@@ -24,6 +24,25 @@ include_directories(SYSTEM ${Ice_INCLUDE_DIRS})
 find_package(Bullet REQUIRED)
 include_directories(SYSTEM ${BULLET_INCLUDE_DIRS})
 
+# must match the Bullet build (BULLET2_MULTITHREADING) for its headers to
+# agree with the library; needed for multithreaded physics
+option(BULLET_THREADSAFE "Bullet is built with multithreading support" OFF)
+if(BULLET_THREADSAFE)
+  add_definitions(-DBT_THREADSAFE=1)
+endif()
+
+# EGL (optional) -- for headless rendering
+find_path(EGL_INCLUDE_DIR EGL/egl.h)
+find_library(EGL_LIBRARY EGL)
+if(EGL_INCLUDE_DIR AND EGL_LIBRARY)
+  message(STATUS "Found EGL: ${EGL_LIBRARY}")
+  add_definitions(-DHAVE_EGL)
+  include_directories(SYSTEM ${EGL_INCLUDE_DIR})
+else()
+  message(STATUS "EGL not found, headless mode is disabled")
+  set(EGL_LIBRARY "")
+endif()
+
 
 #########################################################################
 # Download and build other external dependencies
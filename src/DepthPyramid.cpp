@@ -0,0 +1,243 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+DepthPyramid::DepthPyramid() {
+  glGenVertexArrays(1, &_vao);
+  glGenFramebuffers(1, &_resolveFBO);
+  glGenFramebuffers(1, &_reduceFBO);
+  glGenBuffers(READBACK_LATENCY, _pbo);
+
+  // full screen triangle; each texel keeps the max depth of its footprint in
+  // the source level, which also covers the odd rows/columns of NPOT levels
+  _reduceShader.loadString(Shader::Vertex, R"(
+#version 330 core
+
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)");
+  _reduceShader.loadString(Shader::Fragment, R"(
+#version 330 core
+
+uniform sampler2D source;
+uniform vec2 sourceSize; // used corner of the source
+uniform vec2 levelSize;
+out float depth;
+
+void main() {
+  ivec2 size = ivec2(levelSize);
+  ivec2 srcSize = ivec2(sourceSize);
+  ivec2 p = ivec2(gl_FragCoord.xy);
+  ivec2 lo = p * srcSize / size;
+  ivec2 hi = max(lo + 1, ((p + 1) * srcSize + size - 1) / size);
+  float d = 0.0;
+  for (int y = lo.y; y < hi.y; ++y) {
+    for (int x = lo.x; x < hi.x; ++x)
+      d = max(d, texelFetch(source, ivec2(x, y), 0).r);
+  }
+  depth = d;
+}
+)");
+  _sourceUniform = _reduceShader.uniform<int>("source");
+  _sourceSizeUniform = _reduceShader.uniform<glm::vec2>("sourceSize");
+  _levelSizeUniform = _reduceShader.uniform<glm::vec2>("levelSize");
+}
+
+DepthPyramid::~DepthPyramid() {
+  release();
+  glDeleteBuffers(READBACK_LATENCY, _pbo);
+  glDeleteFramebuffers(1, &_resolveFBO);
+  glDeleteFramebuffers(1, &_reduceFBO);
+  glDeleteVertexArrays(1, &_vao);
+}
+
+void DepthPyramid::build(GLuint framebuffer, int width, int height,
+                         const glm::mat4& viewProjection, bool readback) {
+  assert(width <= _textureWidth && height <= _textureHeight &&
+         "reserve() the size first");
+  _width = width;
+  _height = height;
+
+  // resolve the (multisampled) depth buffer
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _resolveFBO);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+  // reduce level by level; the source level is isolated with BASE/MAX_LEVEL
+  // so that reading and writing the same texture is well defined
+  glDisable(GL_DEPTH_TEST);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, _reduceFBO);
+  glBindVertexArray(_vao);
+  _reduceShader.use();
+  _reduceShader.set(_sourceUniform, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glm::vec2 sourceSize(width, height);
+  for (int level = 0; level < _levels; ++level) {
+    int w = std::max(1, width >> level), h = std::max(1, height >> level);
+    if (level == 0) {
+      glBindTexture(GL_TEXTURE_2D, _depthTexture);
+    } else {
+      glBindTexture(GL_TEXTURE_2D, _texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           _texture, level);
+    glViewport(0, 0, w, h);
+    _reduceShader.set(_sourceSizeUniform, sourceSize);
+    _reduceShader.set(_levelSizeUniform, glm::vec2(w, h));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    sourceSize = glm::vec2(w, h);
+  }
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _levels - 1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindVertexArray(0);
+
+  _viewProjection = viewProjection;
+  _valid = true;
+
+  if (readback)
+    this->readback(_readbackLevel);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void DepthPyramid::readback(int level) {
+  int w = std::max(1, _width >> level), h = std::max(1, _height >> level);
+  GLsizeiptr size = w * h * sizeof(float);
+
+  // pick up the oldest copy if the GPU is done with it; it may be of another
+  // size, if the resolution scale changed since
+  _pboSlot = (_pboSlot + 1) % READBACK_LATENCY;
+  GLsync& fence = _fences[_pboSlot];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[_pboSlot]);
+  if (fence) {
+    if (glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+      int pboWidth = _pboWidth[_pboSlot], pboHeight = _pboHeight[_pboSlot];
+      auto data = static_cast<const float*>(glMapBufferRange(
+          GL_PIXEL_PACK_BUFFER, 0, pboWidth * pboHeight * sizeof(float),
+          GL_MAP_READ_BIT));
+      if (data) {
+        _cpuDepth.assign(data, data + pboWidth * pboHeight);
+        _cpuWidth = pboWidth;
+        _cpuHeight = pboHeight;
+        _cpuViewProjection = _pboViewProjection[_pboSlot];
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  // queue a copy of this frame's level
+  glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         _texture, level);
+  glReadPixels(0, 0, w, h, GL_RED, GL_FLOAT, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _fences[_pboSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  _pboViewProjection[_pboSlot] = _viewProjection;
+  _pboWidth[_pboSlot] = w;
+  _pboHeight[_pboSlot] = h;
+}
+
+bool DepthPyramid::isOccluded(const glm::vec3& min,
+                              const glm::vec3& max) const {
+  if (_cpuDepth.empty())
+    return false;
+
+  // screen space bounds of the box when the pyramid was rendered
+  glm::vec3 lo(1.0f), hi(-1.0f);
+  for (int i = 0; i < 8; ++i) {
+    glm::vec4 corner(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+                     i & 4 ? max.z : min.z, 1.0f);
+    glm::vec4 clip = _cpuViewProjection * corner;
+    if (clip.w <= 0.0f)
+      return false; // crosses the camera plane
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    lo = glm::min(lo, ndc);
+    hi = glm::max(hi, ndc);
+  }
+  if (lo.z < -1.0f)
+    return false;
+
+  auto texel = [](float ndc, int size) {
+    int t = static_cast<int>((ndc * 0.5f + 0.5f) * size);
+    return std::min(std::max(t, 0), size - 1);
+  };
+  int x0 = texel(lo.x, _cpuWidth), x1 = texel(hi.x, _cpuWidth);
+  int y0 = texel(lo.y, _cpuHeight), y1 = texel(hi.y, _cpuHeight);
+  float depth = lo.z * 0.5f + 0.5f;
+
+  for (int y = y0; y <= y1; ++y) {
+    const float* row = &_cpuDepth[y * _cpuWidth];
+    for (int x = x0; x <= x1; ++x) {
+      if (row[x] >= depth)
+        return false;
+    }
+  }
+  return true;
+}
+
+void DepthPyramid::reserve(int width, int height) {
+  if (width == _textureWidth && height == _textureHeight)
+    return;
+  release();
+
+  _textureWidth = width;
+  _textureHeight = height;
+  _levels = 1 + static_cast<int>(std::log2(std::max(width, height)));
+
+  glGenTextures(1, &_depthTexture);
+  glBindTexture(GL_TEXTURE_2D, _depthTexture);
+  // must match the format of the window's depth buffer for the blit
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+               GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, _resolveFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         _depthTexture, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+
+  glGenTextures(1, &_texture);
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  for (int level = 0; level < _levels; ++level) {
+    int w = std::max(1, width >> level), h = std::max(1, height >> level);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, w, h, 0, GL_RED, GL_FLOAT,
+                 nullptr);
+  }
+  _readbackLevel = 0;
+  while ((width >> _readbackLevel) > READBACK_MAX_SIZE)
+    ++_readbackLevel;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void DepthPyramid::release() {
+  glDeleteTextures(1, &_depthTexture);
+  glDeleteTextures(1, &_texture);
+  _depthTexture = _texture = 0;
+  for (auto& fence : _fences) {
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  _cpuDepth.clear();
+  _valid = false;
+}
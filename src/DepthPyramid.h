@@ -0,0 +1,90 @@
+#ifndef _DEPTHPYRAMID_H_
+#define _DEPTHPYRAMID_H_
+
+#include "Shader.h"
+#include <vector>
+
+/*
+ * Hierarchical-Z buffer for occlusion culling.
+ *
+ * Each frame the depth buffer is reduced into a mip chain where every texel
+ * holds the farthest depth of its footprint. Next frame, anything whose
+ * nearest depth lies behind the pyramid texels it covers is hidden.
+ *
+ * The pyramid is sampled directly by GPU culling, while a coarse level is
+ * read back asynchronously (a few frames late) for CPU-side tests.
+ *
+ * Like RenderTarget, the textures are allocated once for the largest size in
+ * use, and smaller frames are reduced into the lower left corner of every
+ * level, so changing the resolution scale doesn't reallocate them or throw
+ * away the depth read back so far.
+ */
+class DepthPyramid {
+public:
+  DepthPyramid();
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid&) = delete;
+  DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+  // (Re)allocates the textures if their size differs from the given one.
+  void reserve(int width, int height);
+
+  // Rebuilds the pyramid from the lower left `width` x `height` pixels of the
+  // depth buffer of `framebuffer` (which may be multisampled), as rendered
+  // with `viewProjection`; at most the reserved size. The framebuffer is left
+  // bound, GL_DEPTH_TEST enabled and the polygon mode set to GL_FILL. Set
+  // `readback` to queue a copy of a coarse level for isOccluded().
+  void build(GLuint framebuffer, int width, int height,
+             const glm::mat4& viewProjection, bool readback);
+
+  // True once build() has completed since the textures were allocated.
+  bool isValid() const { return _valid; }
+
+  // Pyramid for GPU tests, with GL_NEAREST_MIPMAP_NEAREST filtering. Only
+  // the lower left getSize() texels of level 0 are built, and of level n
+  // that size shifted right by n (at least 1), so it is read with texelFetch.
+  GLuint getTexture() const { return _texture; }
+  glm::vec2 getSize() const { return glm::vec2(_width, _height); }
+  const glm::mat4& getViewProjection() const { return _viewProjection; }
+
+  // Tests an axis-aligned box against the latest read back level. Returns
+  // true only when the box is certainly hidden.
+  bool isOccluded(const glm::vec3& min, const glm::vec3& max) const;
+
+private:
+  void release();
+  void readback(int level);
+
+private:
+  static constexpr int READBACK_LATENCY = 3;  // frames in flight
+  static constexpr int READBACK_MAX_SIZE = 128; // widest level read back
+
+  bool _valid = false;
+  int _width = 0, _height = 0; // last built
+  int _textureWidth = 0, _textureHeight = 0, _levels = 0;
+  glm::mat4 _viewProjection;
+
+  Shader _reduceShader;
+  Shader::Uniform<int> _sourceUniform;
+  Shader::Uniform<glm::vec2> _sourceSizeUniform, _levelSizeUniform;
+  GLuint _vao = 0;
+  GLuint _depthTexture = 0; // single-sampled copy of the depth buffer
+  GLuint _texture = 0;      // R32F pyramid
+  GLuint _resolveFBO = 0, _reduceFBO = 0;
+
+  // asynchronous readback ring for CPU tests
+  GLuint _pbo[READBACK_LATENCY] = {};
+  GLsync _fences[READBACK_LATENCY] = {};
+  glm::mat4 _pboViewProjection[READBACK_LATENCY];
+  int _pboWidth[READBACK_LATENCY] = {}, _pboHeight[READBACK_LATENCY] = {};
+  int _pboSlot = 0;
+  int _readbackLevel = 0;
+
+  // latest level available on the CPU
+  std::vector<float> _cpuDepth;
+  int _cpuWidth = 0, _cpuHeight = 0;
+  glm::mat4 _cpuViewProjection;
+};
+
+#endif // _DEPTHPYRAMID_H_
@@ -0,0 +1,126 @@
+#include "FramePacer.h"
+#include "Window.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// time kept in reserve when sleeping until the predicted deadline, for
+// scheduler wake-up delays and mispredictions
+const double SAFETY_MARGIN = 0.001;
+
+// weight of a new sample in the smoothed frame times
+const double SMOOTHING = 0.1;
+
+const char* const MODE_NAMES[] = {"vsync", "adaptive", "uncapped",
+                                  "low-latency"};
+
+const char* FramePacer::getModeName(Mode mode) {
+  return MODE_NAMES[mode];
+}
+
+FramePacer::FramePacer() {
+  _logger = spdlog::stdout_logger_mt("pacer", true /*use color*/);
+}
+
+FramePacer::~FramePacer() {
+  glDeleteSync(_fence);
+}
+
+void FramePacer::setMode(Window& window, Mode mode) {
+  const int INTERVALS[] = {1, -1, 0, 1};
+  if (!window.setSwapInterval(INTERVALS[mode])) {
+    _logger->warn() << "Swap interval " << INTERVALS[mode]
+                    << " is not supported, using v-sync";
+    mode = VSync;
+    window.setSwapInterval(1);
+  }
+  _mode = mode;
+
+  int refreshRate = window.getRefreshRate();
+  if (refreshRate > 0)
+    _refreshPeriod = 1.0 / refreshRate;
+  _logger->info() << "Frame pacing: " << getModeName(_mode) << " at "
+                  << 1.0 / _refreshPeriod << " Hz";
+}
+
+void FramePacer::beginFrame() {
+  if (_mode == LowLatency) {
+    // the previous frame has to be done before this one starts, so that
+    // commands never pile up in the driver
+    if (_fence) {
+      GLenum result;
+      do {
+        result = glClientWaitSync(_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      } while (result == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(_fence);
+      _fence = nullptr;
+    }
+
+    // start as late as possible to still make the vertical blank after the
+    // last swap
+    if (_numFrames > 0) {
+      double budget = _cpuTime + 2.0 * _cpuTimeDeviation + _gpuTime +
+                      SAFETY_MARGIN;
+      auto start = _lastSwap + std::chrono::duration_cast<clock::duration>(
+                                   std::chrono::duration<double>(
+                                       _refreshPeriod - budget));
+      if (start > clock::now())
+        std::this_thread::sleep_until(start);
+    }
+  }
+  _frameStart = clock::now();
+}
+
+void FramePacer::endFrame(double gpuTime) {
+  double cpuTime =
+      std::chrono::duration<double>(clock::now() - _frameStart).count();
+  double deviation = std::abs(cpuTime - _cpuTime);
+  _cpuTime += SMOOTHING * (cpuTime - _cpuTime);
+  _cpuTimeDeviation += SMOOTHING * (deviation - _cpuTimeDeviation);
+  _gpuTime = gpuTime;
+
+  if (_mode == LowLatency) {
+    glDeleteSync(_fence);
+    _fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+void FramePacer::framePresented(clock::time_point inputTime) {
+  auto now = clock::now();
+  int index = _numFrames % HISTORY;
+  _intervals[index] =
+      _numFrames > 0 ? std::chrono::duration<double>(now - _lastSwap).count()
+                     : 0.0;
+  _latencies[index] = std::chrono::duration<double>(now - inputTime).count();
+  _lastSwap = now;
+  ++_numFrames;
+  updateStats();
+}
+
+void FramePacer::updateStats() {
+  // the first frame has no interval
+  int count = std::min(_numFrames, HISTORY);
+  int intervals = std::min(_numFrames - 1, HISTORY);
+
+  double intervalSum = 0.0, latencySum = 0.0;
+  _stats.maxLatency = 0.0;
+  for (int i = 0; i < count; ++i) {
+    intervalSum += _intervals[i];
+    latencySum += _latencies[i];
+    _stats.maxLatency = std::max(_stats.maxLatency, _latencies[i]);
+  }
+  _stats.latency = latencySum / count;
+  if (intervals < 1)
+    return;
+
+  _stats.frameTime = intervalSum / intervals;
+  double variance = 0.0;
+  for (int i = 0; i < count; ++i) {
+    if (_intervals[i] > 0.0) {
+      double difference = _intervals[i] - _stats.frameTime;
+      variance += difference * difference;
+    }
+  }
+  _stats.jitter = std::sqrt(variance / intervals);
+}
@@ -0,0 +1,90 @@
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#include "glad.h"
+#include <chrono>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+class Window;
+
+/*
+ * Decides when the render thread starts a frame, and measures how long
+ * input takes to reach the screen and how evenly frames are presented.
+ *
+ * Besides the plain swap intervals, LowLatency keeps at most one frame in
+ * flight (waiting on a fence of the previous one) and sleeps until just
+ * before the latest time a frame can start and still make the next vertical
+ * blank, as predicted from recent frame times. Frames are then drawn from
+ * the freshest input instead of waiting in the driver's queue.
+ */
+class FramePacer {
+public:
+  enum Mode {
+    VSync,         // swap interval 1
+    AdaptiveVSync, // swap interval -1: late frames tear instead of waiting
+    Uncapped,      // swap interval 0, for benchmarks
+    LowLatency,    // swap interval 1, rendering just in time
+    ModeCount
+  };
+  static const char* getModeName(Mode mode);
+
+  using clock = std::chrono::steady_clock;
+
+  FramePacer();
+  ~FramePacer();
+
+  FramePacer(const FramePacer&) = delete;
+  FramePacer& operator=(const FramePacer&) = delete;
+
+  // Render thread, with the GL context current: applies `mode` to the
+  // window, falling back to VSync if adaptive v-sync isn't supported.
+  void setMode(Window& window, Mode mode);
+  Mode getMode() const { return _mode; }
+
+  // Waits until the next frame should be rendered.
+  void beginFrame();
+
+  // Called when the frame has been submitted, right before the buffer swap,
+  // with the recent GPU time of a frame in seconds.
+  void endFrame(double gpuTime);
+
+  // Called right after the buffer swap of a frame whose input was sampled
+  // at `inputTime`.
+  void framePresented(clock::time_point inputTime);
+
+  // Measurements over the last HISTORY frames, in seconds.
+  struct Stats {
+    double frameTime = 0.0; // average time between swaps
+    double jitter = 0.0;    // standard deviation of the time between swaps
+    double latency = 0.0;   // average time from input to swap
+    double maxLatency = 0.0;
+  };
+  const Stats& getStats() const { return _stats; }
+
+private:
+  static constexpr int HISTORY = 120;
+
+  void updateStats();
+
+private:
+  Mode _mode = VSync;
+  std::shared_ptr<spdlog::logger> _logger;
+
+  // deadline prediction (LowLatency)
+  double _refreshPeriod = 1.0 / 60.0;
+  double _cpuTime = 0.0;          // smoothed CPU time of a frame
+  double _cpuTimeDeviation = 0.0; // smoothed deviation from it
+  double _gpuTime = 0.0;
+  clock::time_point _frameStart;
+  GLsync _fence = nullptr; // of the frame in flight
+
+  // measurements
+  clock::time_point _lastSwap;
+  double _intervals[HISTORY] = {};
+  double _latencies[HISTORY] = {};
+  int _numFrames = 0;
+  Stats _stats;
+};
+
+#endif // _FRAMEPACER_H_
@@ -0,0 +1,103 @@
+#ifndef _FRAMEPACKET_H_
+#define _FRAMEPACKET_H_
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ways a BoxInstance can hold the transform of a box.
+enum InstanceFormat {
+  MatrixInstances,    // the columns of the model matrix
+  TransformInstances, // a btTransform as stored by Bullet: the rows of the
+                      // rotation (w unused) followed by the origin
+  QuantizedInstances, // a QuantizedBoxInstance
+  InstanceFormatCount
+};
+
+// Vertex layouts of the box mesh, selectable to compare their cost.
+enum CubeMesh {
+  IndexedCube, // 24 vertices with packed normals, indexed, back faces culled
+  ArrayCube,   // 36 vertices of six floats, drawn without face culling
+  CubeMeshCount
+};
+
+// Per-instance vertex attributes of the box shaders.
+struct BoxInstance {
+  glm::vec4 transform[4]; // see InstanceFormat
+  glm::vec3 color;
+};
+
+// Compact alternative to BoxInstance (see Quantize.h).
+struct QuantizedBoxInstance {
+  uint16_t position[4]; // half floats, relative to the view position
+                        // (w unused)
+  uint32_t rotation;    // quaternion: the smallest three components with
+                        // 10 bits each, and the index of the largest one in
+                        // the top 2 bits
+  uint32_t color;       // RGBA8 (alpha unused)
+};
+
+// Size in bytes of an instance of `format`.
+inline size_t instanceSize(InstanceFormat format) {
+  return format == QuantizedInstances ? sizeof(QuantizedBoxInstance)
+                                      : sizeof(BoxInstance);
+}
+
+/*
+ * Dynamic resolution: the scene is drawn at a fraction of the viewport size
+ * that adapts to hold the measured GPU frame time at a target, and then
+ * stretched over the viewport.
+ */
+struct ResolutionSettings {
+  bool dynamic = true;
+  float targetFrameTime = 14.0f; // GPU milliseconds
+  float minScale = 0.5f, maxScale = 1.0f;
+};
+
+/*
+ * Everything the renderer needs to draw one frame, captured by the
+ * simulation thread and then read (but never modified) by the render thread.
+ */
+struct FramePacket {
+  // level of detail tiers of the boxes, nearest first
+  enum Lod {
+    Full,     // lit cube
+    Simple,   // cube with per-vertex diffuse lighting only
+    Impostor, // one point sprite per box
+    LodCount
+  };
+
+  // viewport
+  int width = 0, height = 0;
+  float pointScale = 0.0f; // point size of a unit at a view distance of 1
+
+  // camera
+  glm::mat4 viewProjection;
+  glm::vec3 viewPos;
+  float time = 0.0f;
+  std::chrono::steady_clock::time_point inputTime; // when input was read
+
+  // settings
+  bool wireframe = false;
+  bool gpuCulling = false;
+  bool occlusionCulling = false;
+  bool profilerOverlay = false;
+  bool pipelineStatistics = false;
+  InstanceFormat instanceFormat = TransformInstances;
+  CubeMesh cubeMesh = IndexedCube;
+  ResolutionSettings resolution;
+
+  // boxes in the view frustum, or all of them when culling on the GPU,
+  // grouped by Lod, as instances of instanceFormat stored back to back
+  std::vector<unsigned char> boxes;
+  size_t lodCounts[LodCount] = {};
+  size_t totalBoxes = 0; // in the world
+
+  size_t getBoxCount() const {
+    return boxes.size() / instanceSize(instanceFormat);
+  }
+};
+
+#endif // _FRAMEPACKET_H_
@@ -0,0 +1,29 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+/*
+ * View frustum planes extracted from a view-projection matrix (Gribb and
+ * Hartmann). A point p is inside when dot(plane.xyz, p) + plane.w >= 0 for
+ * every plane. Plane normals point inwards and are normalized.
+ */
+struct Frustum {
+  enum Plane { Left, Right, Bottom, Top, Near, Far, Count };
+
+  explicit Frustum(const glm::mat4& viewProjection) {
+    const glm::mat4& m = viewProjection;
+    for (int i = 0; i < 3; ++i) {
+      glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+      glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+      planes[2 * i] = w + row;
+      planes[2 * i + 1] = w - row;
+    }
+    for (auto& plane : planes)
+      plane /= glm::length(glm::vec3(plane));
+  }
+
+  glm::vec4 planes[Count];
+};
+
+#endif // _FRUSTUM_H_
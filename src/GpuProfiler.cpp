@@ -0,0 +1,315 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// GL_ARB_pipeline_statistics_query, which is core only since GL 4.6
+#ifndef GL_VERTICES_SUBMITTED_ARB
+#define GL_VERTICES_SUBMITTED_ARB 0x82EE
+#define GL_PRIMITIVES_SUBMITTED_ARB 0x82EF
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#define GL_COMPUTE_SHADER_INVOCATIONS_ARB 0x82F5
+#define GL_CLIPPING_OUTPUT_PRIMITIVES_ARB 0x82F7
+#endif
+
+// query targets of GpuProfiler::Statistic
+const GLenum STATISTIC_TARGETS[] = {
+    GL_VERTICES_SUBMITTED_ARB,         GL_PRIMITIVES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,  GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB, GL_COMPUTE_SHADER_INVOCATIONS_ARB,
+};
+
+constexpr GLuint rgba(GLuint r, GLuint g, GLuint b, GLuint a) {
+  return a << 24 | b << 16 | g << 8 | r;
+}
+
+// overlay colors of the passes, in order of their first use
+const GLuint PASS_COLORS[] = {
+    rgba(230, 25, 75, 255),  rgba(60, 180, 75, 255), rgba(0, 130, 200, 255),
+    rgba(255, 225, 25, 255), rgba(145, 30, 180, 255), rgba(70, 240, 240, 255),
+    rgba(245, 130, 48, 255), rgba(240, 50, 230, 255),
+};
+const int NUM_PASS_COLORS = sizeof(PASS_COLORS) / sizeof(GLuint);
+
+// overlay graph area in normalized device coordinates, and the frame time
+// that spans its full height
+const float OVERLAY_LEFT = -0.98f, OVERLAY_BOTTOM = -0.98f;
+const float OVERLAY_WIDTH = 0.6f, OVERLAY_HEIGHT = 0.4f;
+const float OVERLAY_SCALE_MS = 1000.0f / 30.0f;
+
+static bool hasExtension(const char* name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; ++i) {
+    auto extension = reinterpret_cast<const char*>(
+        glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+    if (std::strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+GpuProfiler::GpuProfiler() {
+  _hasPipelineStatistics = hasExtension("GL_ARB_pipeline_statistics_query");
+  std::fill(std::begin(_frameHistory), std::end(_frameHistory), -1.0f);
+
+  glGenVertexArrays(1, &_overlayVAO);
+  glGenBuffers(1, &_overlayVBO);
+
+  glBindVertexArray(_overlayVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, _overlayVBO);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex),
+                        (GLvoid*)offsetof(OverlayVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                        sizeof(OverlayVertex),
+                        (GLvoid*)offsetof(OverlayVertex, color));
+
+  glBindVertexArray(0);
+
+  _overlayShader.loadString(Shader::Vertex, R"(
+#version 330 core
+
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec4 color;
+out vec4 Color;
+
+void main() {
+  Color = color;
+  gl_Position = vec4(position, 0.0, 1.0);
+}
+)");
+  _overlayShader.loadString(Shader::Fragment, R"(
+#version 330 core
+
+in vec4 Color;
+out vec4 color;
+
+void main() {
+  color = Color;
+}
+)");
+}
+
+GpuProfiler::~GpuProfiler() {
+  for (auto& pass : _passes) {
+    glDeleteQueries(LATENCY, pass.timeQueries);
+    if (_hasPipelineStatistics)
+      glDeleteQueries(LATENCY * StatisticCount, pass.statisticQueries[0]);
+  }
+  glDeleteVertexArrays(1, &_overlayVAO);
+  glDeleteBuffers(1, &_overlayVBO);
+}
+
+void GpuProfiler::setPipelineStatistics(bool enable) {
+  _pipelineStatistics = enable && _hasPipelineStatistics;
+}
+
+void GpuProfiler::beginFrame() {
+  _slot = _frame % LATENCY;
+  if (_frame < LATENCY)
+    return;
+
+  // the queries of this slot were issued LATENCY frames ago
+  int index = (_frame - LATENCY) % HISTORY;
+  float frameTime = 0.0f;
+  for (size_t i = 0; i < _passes.size(); ++i) {
+    Pass& pass = _passes[i];
+    if (!collect(pass, _stats[i], _slot, index) || frameTime < 0.0f)
+      frameTime = -1.0f;
+    else if (pass.history[index] > 0.0f)
+      frameTime += pass.history[index];
+  }
+  _frameHistory[index] = frameTime;
+
+  for (size_t i = 0; i < _passes.size(); ++i)
+    computeTimings(_passes[i].history, index, _stats[i].time);
+  computeTimings(_frameHistory, index, _frameStats);
+}
+
+void GpuProfiler::endFrame() {
+  end();
+  ++_frame;
+}
+
+void GpuProfiler::begin(const char* name) {
+  end();
+
+  auto found = std::find_if(_stats.begin(), _stats.end(),
+                            [&](const PassStats& s) { return s.name == name; });
+  _activePass = found - _stats.begin();
+  if (found == _stats.end()) {
+    Pass pass;
+    std::fill(std::begin(pass.history), std::end(pass.history), -1.0f);
+    glGenQueries(LATENCY, pass.timeQueries);
+    if (_hasPipelineStatistics)
+      glGenQueries(LATENCY * StatisticCount, pass.statisticQueries[0]);
+    _passes.push_back(pass);
+
+    PassStats stats;
+    stats.name = name;
+    _stats.push_back(stats);
+  }
+
+  Pass& pass = _passes[_activePass];
+  glBeginQuery(GL_TIME_ELAPSED, pass.timeQueries[_slot]);
+  pass.timePending[_slot] = true;
+  if (_pipelineStatistics) {
+    for (int i = 0; i < StatisticCount; ++i)
+      glBeginQuery(STATISTIC_TARGETS[i], pass.statisticQueries[_slot][i]);
+    pass.statisticsPending[_slot] = true;
+  }
+}
+
+void GpuProfiler::end() {
+  if (_activePass < 0)
+    return;
+
+  Pass& pass = _passes[_activePass];
+  glEndQuery(GL_TIME_ELAPSED);
+  if (pass.statisticsPending[_slot]) {
+    for (int i = 0; i < StatisticCount; ++i)
+      glEndQuery(STATISTIC_TARGETS[i]);
+  }
+  _activePass = -1;
+}
+
+// Reads the results of the queries in `slot`, if they are available, and
+// stores the time into the history at `index`. Returns false if results had
+// to be dropped.
+bool GpuProfiler::collect(Pass& pass, PassStats& stats, int slot, int index) {
+  bool complete = true;
+
+  pass.history[index] = -1.0f;
+  if (pass.timePending[slot]) {
+    GLuint query = pass.timeQueries[slot];
+    GLuint available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+      pass.history[index] = nanoseconds * 1e-6f;
+    } else {
+      ++_dropped;
+      complete = false;
+    }
+    pass.timePending[slot] = false;
+  }
+
+  if (pass.statisticsPending[slot]) {
+    GLuint* queries = pass.statisticQueries[slot];
+    GLuint available = 0;
+    glGetQueryObjectuiv(queries[StatisticCount - 1], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (available) {
+      // queries complete in order, so the others are available as well
+      for (int i = 0; i < StatisticCount; ++i) {
+        GLuint64 value = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &value);
+        stats.statistics[i] = value;
+      }
+    } else {
+      ++_dropped;
+      complete = false;
+    }
+    pass.statisticsPending[slot] = false;
+  }
+
+  return complete;
+}
+
+// Computes the statistics of the known times in `history`, where `latest` is
+// the index of the last collected frame.
+void GpuProfiler::computeTimings(const float* history, int latest,
+                                 Timings& timings) {
+  _sorted.clear();
+  for (int i = 0; i < HISTORY; ++i) {
+    if (history[i] >= 0.0f)
+      _sorted.push_back(history[i]);
+  }
+  if (_sorted.empty()) {
+    timings = Timings();
+    return;
+  }
+  std::sort(_sorted.begin(), _sorted.end());
+
+  auto percentile = [&](float p) {
+    size_t i = static_cast<size_t>(p * _sorted.size());
+    return _sorted[std::min(i, _sorted.size() - 1)];
+  };
+
+  float sum = 0.0f;
+  for (float time : _sorted)
+    sum += time;
+
+  if (history[latest] >= 0.0f)
+    timings.last = history[latest];
+  timings.average = sum / _sorted.size();
+  timings.p50 = percentile(0.50f);
+  timings.p95 = percentile(0.95f);
+  timings.p99 = percentile(0.99f);
+  timings.max = _sorted.back();
+}
+
+void GpuProfiler::drawOverlay(RenderQueue& queue) {
+  _overlayVertices.clear();
+  auto addQuad = [&](float x0, float y0, float x1, float y1, GLuint color) {
+    const OverlayVertex quad[] = {
+        {{x0, y0}, color}, {{x1, y0}, color}, {{x1, y1}, color},
+        {{x1, y1}, color}, {{x0, y1}, color}, {{x0, y0}, color},
+    };
+    _overlayVertices.insert(_overlayVertices.end(), std::begin(quad),
+                            std::end(quad));
+  };
+
+  // background
+  const float right = OVERLAY_LEFT + OVERLAY_WIDTH;
+  const float top = OVERLAY_BOTTOM + OVERLAY_HEIGHT;
+  addQuad(OVERLAY_LEFT, OVERLAY_BOTTOM, right, top, rgba(0, 0, 0, 160));
+
+  // one column per frame, oldest on the left, with the passes stacked
+  const float columnWidth = OVERLAY_WIDTH / HISTORY;
+  const float msHeight = OVERLAY_HEIGHT / OVERLAY_SCALE_MS;
+  for (int column = 0; column < HISTORY; ++column) {
+    int64_t frame = static_cast<int64_t>(_frame) - LATENCY - HISTORY + 1 +
+                    column;
+    if (frame < 0)
+      continue;
+    int index = frame % HISTORY;
+
+    float x = OVERLAY_LEFT + column * columnWidth;
+    float y = OVERLAY_BOTTOM;
+    for (size_t i = 0; i < _passes.size(); ++i) {
+      float time = _passes[i].history[index];
+      if (time <= 0.0f)
+        continue;
+      float height = std::min(time * msHeight, top - y);
+      addQuad(x, y, x + columnWidth, y + height,
+              PASS_COLORS[i % NUM_PASS_COLORS]);
+      y += height;
+    }
+  }
+
+  // 60 Hz budget
+  float budget = OVERLAY_BOTTOM + 1000.0f / 60.0f * msHeight;
+  addQuad(OVERLAY_LEFT, budget, right, budget + 0.004f,
+          rgba(255, 255, 255, 200));
+
+  glBindBuffer(GL_ARRAY_BUFFER, _overlayVBO);
+  glBufferData(GL_ARRAY_BUFFER, _overlayVertices.size() * sizeof(OverlayVertex),
+               _overlayVertices.data(), GL_STREAM_DRAW);
+
+  DrawPacket packet;
+  packet.shader = &_overlayShader;
+  packet.vao = _overlayVAO;
+  packet.state.blend = true;
+  packet.state.depthTest = false;
+  packet.state.depthWrite = false;
+  packet.state.cullFace = false;
+  packet.count = _overlayVertices.size();
+  queue.submit(packet);
+}
@@ -0,0 +1,126 @@
+#ifndef _GPUPROFILER_H_
+#define _GPUPROFILER_H_
+
+#include "RenderQueue.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * GPU time (and optionally pipeline statistics) of named render passes.
+ *
+ * Passes are bracketed with begin()/end() and measured with GL_TIME_ELAPSED
+ * queries. Each pass keeps a ring of queries, so results are collected a few
+ * frames later without ever waiting on the GPU; a result that still isn't
+ * available then is dropped. Passes can't nest.
+ */
+class GpuProfiler {
+public:
+  GpuProfiler();
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  // Counters of GL_ARB_pipeline_statistics_query.
+  enum Statistic {
+    VerticesSubmitted,
+    PrimitivesSubmitted,
+    VertexShaderInvocations,
+    ClippingOutputPrimitives,
+    FragmentShaderInvocations,
+    ComputeShaderInvocations,
+    StatisticCount
+  };
+
+  // Pipeline statistics are only gathered when supported and enabled.
+  bool hasPipelineStatistics() const { return _hasPipelineStatistics; }
+  void setPipelineStatistics(bool enable);
+
+  // Bracket the frame; beginFrame() collects the results of older frames.
+  void beginFrame();
+  void endFrame();
+
+  // Bracket a pass; passes are identified by name.
+  void begin(const char* name);
+  void end();
+
+  // Measures a pass for the lifetime of the scope.
+  class Scope {
+  public:
+    Scope(GpuProfiler& profiler, const char* name) : _profiler(profiler) {
+      _profiler.begin(name);
+    }
+    ~Scope() { _profiler.end(); }
+
+  private:
+    GpuProfiler& _profiler;
+  };
+
+  // Timings in milliseconds over the last HISTORY frames.
+  struct Timings {
+    float last = 0.0f;
+    float average = 0.0f;
+    float p50 = 0.0f, p95 = 0.0f, p99 = 0.0f;
+    float max = 0.0f;
+  };
+
+  struct PassStats {
+    std::string name;
+    Timings time;
+    uint64_t statistics[StatisticCount] = {}; // of the last collected frame
+  };
+
+  // Statistics per pass, in order of their first use, and of whole frames
+  // (the sum of all passes).
+  const std::vector<PassStats>& getPassStats() const { return _stats; }
+  const Timings& getFrameStats() const { return _frameStats; }
+
+  // Results that weren't available in time and were dropped.
+  uint64_t getDroppedResults() const { return _dropped; }
+
+  // Submits a graph of the recent per-pass timings to `queue`, drawn into the
+  // lower left corner of the viewport on top of everything else.
+  void drawOverlay(RenderQueue& queue);
+
+private:
+  static constexpr int LATENCY = 4;   // frames until results are read
+  static constexpr int HISTORY = 240; // frames of timings kept
+
+  struct Pass {
+    GLuint timeQueries[LATENCY] = {};
+    GLuint statisticQueries[LATENCY][StatisticCount] = {};
+    bool timePending[LATENCY] = {};
+    bool statisticsPending[LATENCY] = {};
+    float history[HISTORY]; // milliseconds per frame, or < 0 if unknown
+  };
+
+  bool collect(Pass& pass, PassStats& stats, int slot, int index);
+  void computeTimings(const float* history, int latest, Timings& timings);
+
+private:
+  bool _hasPipelineStatistics = false;
+  bool _pipelineStatistics = false;
+
+  uint64_t _frame = 0;
+  int _slot = 0;          // query slot of the current frame
+  int _activePass = -1;   // pass between begin() and end()
+  uint64_t _dropped = 0;
+
+  std::vector<Pass> _passes;
+  std::vector<PassStats> _stats;
+  float _frameHistory[HISTORY];
+  Timings _frameStats;
+  std::vector<float> _sorted; // scratch for percentiles
+
+  // overlay
+  Shader _overlayShader;
+  GLuint _overlayVAO = 0, _overlayVBO = 0;
+  struct OverlayVertex {
+    GLfloat position[2];
+    GLuint color; // RGBA8
+  };
+  std::vector<OverlayVertex> _overlayVertices;
+};
+
+#endif // _GPUPROFILER_H_
@@ -1,16 +1,83 @@
 #include "Graphics.h"
+#include "Frustum.h"
+#include "Quantize.h"
 #include "Window.h"
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
 
 // unit ground plane
 const GLfloat GROUND[] = { // x, y, z, ...
     -0.5f, 0.0f, 0.5f, 0.5f, 0.0f, 0.5f,  0.5f,  0.0f, -0.5f,
     -0.5f, 0.0f, 0.5f, 0.5f, 0.0f, -0.5f, -0.5f, 0.0f, -0.5f};
 
-// unit cube with normals
-const GLfloat CUBE[] = { // x, y, z, nx, ny, nz, ...
+// packs a unit normal as GL_INT_2_10_10_10_REV (w = 0)
+constexpr GLuint packNormal(int x, int y, int z) {
+  return ((z * 511) & 0x3FF) << 20 | ((y * 511) & 0x3FF) << 10 |
+         ((x * 511) & 0x3FF);
+}
+
+struct CubeVertex {
+  GLfloat position[3];
+  GLuint normal;
+};
+
+// unit cube with packed normals; 4 vertices per face, wound counter-clockwise
+// when seen from outside
+const CubeVertex CUBE[] = {
+    // -X
+    {{-0.5f, -0.5f, -0.5f}, packNormal(-1, 0, 0)},
+    {{-0.5f, -0.5f, 0.5f}, packNormal(-1, 0, 0)},
+    {{-0.5f, 0.5f, 0.5f}, packNormal(-1, 0, 0)},
+    {{-0.5f, 0.5f, -0.5f}, packNormal(-1, 0, 0)},
+    // +X
+    {{0.5f, -0.5f, 0.5f}, packNormal(1, 0, 0)},
+    {{0.5f, -0.5f, -0.5f}, packNormal(1, 0, 0)},
+    {{0.5f, 0.5f, -0.5f}, packNormal(1, 0, 0)},
+    {{0.5f, 0.5f, 0.5f}, packNormal(1, 0, 0)},
+    // -Y
+    {{-0.5f, -0.5f, -0.5f}, packNormal(0, -1, 0)},
+    {{0.5f, -0.5f, -0.5f}, packNormal(0, -1, 0)},
+    {{0.5f, -0.5f, 0.5f}, packNormal(0, -1, 0)},
+    {{-0.5f, -0.5f, 0.5f}, packNormal(0, -1, 0)},
+    // +Y
+    {{-0.5f, 0.5f, 0.5f}, packNormal(0, 1, 0)},
+    {{0.5f, 0.5f, 0.5f}, packNormal(0, 1, 0)},
+    {{0.5f, 0.5f, -0.5f}, packNormal(0, 1, 0)},
+    {{-0.5f, 0.5f, -0.5f}, packNormal(0, 1, 0)},
+    // -Z
+    {{0.5f, -0.5f, -0.5f}, packNormal(0, 0, -1)},
+    {{-0.5f, -0.5f, -0.5f}, packNormal(0, 0, -1)},
+    {{-0.5f, 0.5f, -0.5f}, packNormal(0, 0, -1)},
+    {{0.5f, 0.5f, -0.5f}, packNormal(0, 0, -1)},
+    // +Z
+    {{-0.5f, -0.5f, 0.5f}, packNormal(0, 0, 1)},
+    {{0.5f, -0.5f, 0.5f}, packNormal(0, 0, 1)},
+    {{0.5f, 0.5f, 0.5f}, packNormal(0, 0, 1)},
+    {{-0.5f, 0.5f, 0.5f}, packNormal(0, 0, 1)},
+};
+
+// two triangles per face, face by face: each vertex is transformed once even
+// with the smallest post-transform cache, the optimum for 24 vertices
+const GLubyte CUBE_INDICES[] = {
+    0,  1,  2,  2,  3,  0,  // -X
+    4,  5,  6,  6,  7,  4,  // +X
+    8,  9,  10, 10, 11, 8,  // -Y
+    12, 13, 14, 14, 15, 12, // +Y
+    16, 17, 18, 18, 19, 16, // -Z
+    20, 21, 22, 22, 23, 20, // +Z
+};
+const GLsizei CUBE_NUM_INDICES = sizeof(CUBE_INDICES) / sizeof(GLubyte);
+
+// the previous unit cube, kept for comparison (see CubeMesh): 36 vertices
+// with unpacked normals; its faces are not wound consistently, so it is
+// drawn without face culling
+const GLfloat CUBE_ARRAY[] = { // x, y, z, nx, ny, nz, ...
     -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,  -1.0f, 0.5f,  -0.5f, -0.5f,
     0.0f,  0.0f,  -1.0f, 0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f,
     0.5f,  0.5f,  -0.5f, 0.0f,  0.0f,  -1.0f, -0.5f, 0.5f,  -0.5f,
@@ -40,14 +107,162 @@ const GLfloat CUBE[] = { // x, y, z, nx, ny, nz, ...
     0.0f,  1.0f,  0.0f,  0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  0.5f,
     0.0f,  1.0f,  0.0f,  -0.5f, 0.5f,  -0.5f, 0.0f,  1.0f,  0.0f};
+const GLsizei CUBE_ARRAY_NUM_VERTICES =
+    sizeof(CUBE_ARRAY) / (6 * sizeof(GLfloat));
+
+// view distances at which boxes switch to the next FramePacket::Lod, and by
+// which fraction of them a box has to cross over before it switches, so that
+// boxes near a threshold don't pop back and forth
+const float LOD_DISTANCES[] = {60.0f, 200.0f};
+const float LOD_HYSTERESIS = 0.1f;
+
+// visible boxes per job when packing them into a frame
+const size_t PACK_GRAIN = 512;
+
+// boxes shot that stay in the world; older ones are removed
+const size_t MAX_SHOT_BOXES = 1000;
+
+// initial content of the GPU culling draw buffer: an indirect draw command
+// per FramePacket::Lod (elements for the cubes, arrays for the impostors)
+// and the number of occluded boxes. ArrayCubes read the commands of the
+// cubes as array draws, whose first four words line up: {count,
+// instanceCount, first = firstIndex, baseInstance = baseVertex}.
+static_assert(CUBE_ARRAY_NUM_VERTICES == CUBE_NUM_INDICES,
+              "both cube meshes must share the indirect draw commands");
+const GLuint CULL_COMMANDS[] = {
+    CUBE_NUM_INDICES, 0, 0, 0, 0, // Full
+    CUBE_NUM_INDICES, 0, 0, 0, 0, // Simple
+    0, 1, 0, 0,                   // Impostor
+    0,                            // occluded boxes
+    0,                            // padding
+};
+const GLuint CULL_COMMAND_OFFSETS[] = {0, 5, 10}; // per Lod
+const GLuint CULL_VISIBLE_COUNTS[] = {1, 6, 10};  // per Lod
+const GLuint CULL_OCCLUDED_COUNT = 14;
+const GLuint CULL_NUM_COUNTS = sizeof(CULL_COMMANDS) / sizeof(GLuint);
+
+// dynamic resolution moves in steps of 1/RESOLUTION_STEPS, and waits a few
+// frames after each step for the GPU timings to catch up (see GpuProfiler)
+const float RESOLUTION_STEPS = 20.0f;
+const int RESOLUTION_COOLDOWN = 8;
+
+// GLSL version and std140 declaration of Graphics::FrameUniforms
+const std::string FRAME_HEADER = R"(#version 330 core
+
+layout (std140) uniform Frame {
+  mat4 viewProjection;
+  vec4 viewPos;
+  vec4 lightPos;
+  vec4 lightColor;
+  float time;
+  float pointScale;
+  float wireframe; // 1 to outline the faces of the boxes
+};
+)";
+
+// box shader inputs per InstanceFormat; each defines the instance color and
+// a function that returns the model matrix
+const std::string INSTANCE_INPUTS[] = {
+    // MatrixInstances
+    R"(
+layout (location = 2) in mat4 model;
+layout (location = 6) in vec3 color;
+
+mat4 instanceModel() {
+  return model;
+}
+)",
+    // TransformInstances
+    R"(
+layout (location = 2) in vec4 basis[3]; // rows
+layout (location = 5) in vec4 origin;
+layout (location = 6) in vec3 color;
+
+mat4 instanceModel() {
+  mat3 rotation = mat3(basis[0].xyz, basis[1].xyz, basis[2].xyz);
+  mat4 model = mat4(transpose(rotation));
+  model[3] = vec4(origin.xyz, 1.0);
+  return model;
+}
+)",
+    // QuantizedInstances (see Quantize.h)
+    R"(
+layout (location = 2) in vec3 offset; // from viewPos
+layout (location = 3) in uint rotation;
+layout (location = 6) in vec3 color;
+
+const float QUATERNION_RANGE = 0.70710678;
+
+mat4 instanceModel() {
+  uvec3 bits = uvec3(rotation, rotation >> 10, rotation >> 20) & 0x3FFu;
+  vec3 others = vec3(bits) * (2.0 * QUATERNION_RANGE / 1023.0) -
+                QUATERNION_RANGE;
+  float largest = sqrt(max(1.0 - dot(others, others), 0.0));
+  uint index = rotation >> 30;
+  vec4 q = index == 0u ? vec4(largest, others)
+         : index == 1u ? vec4(others.x, largest, others.yz)
+         : index == 2u ? vec4(others.xy, largest, others.z)
+                       : vec4(others, largest);
+
+  vec3 q2 = q.xyz * q.xyz, qw = q.xyz * q.w;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  return mat4(1.0 - 2.0 * (q2.y + q2.z), 2.0 * (xy + qw.z), 2.0 * (xz - qw.y),
+              0.0,
+              2.0 * (xy - qw.z), 1.0 - 2.0 * (q2.x + q2.z), 2.0 * (yz + qw.x),
+              0.0,
+              2.0 * (xz + qw.y), 2.0 * (yz - qw.x), 1.0 - 2.0 * (q2.x + q2.y),
+              0.0,
+              viewPos.xyz + offset, 1.0);
+}
+)",
+};
+
+// box vertex shader output for the wireframe: the position of the vertex
+// within its face of the cube, in [-0.5, 0.5]
+const std::string WIREFRAME_OUTPUT = R"(
+out vec2 FaceCoord;
+
+void outputFaceCoord(vec3 position, vec3 normal) {
+  FaceCoord = abs(normal.x) > 0.5 ? position.yz
+            : abs(normal.y) > 0.5 ? position.xz : position.xy;
+}
+)";
+
+// box fragment shader function that draws the edges of the faces over the
+// shaded color when the wireframe is on, with lines about a pixel wide, so
+// the wireframe needs no extra pass or polygon mode
+const std::string WIREFRAME_INPUT = R"(
+in vec2 FaceCoord;
 
-Graphics::Graphics(World& world) : _world(world) {
+const vec3 WIRE_COLOR = vec3(1.0);
+
+vec3 applyWireframe(vec3 color) {
+  vec2 pixels = (0.5 - abs(FaceCoord)) / fwidth(FaceCoord);
+  float edge = 1.0 - smoothstep(0.5, 1.5, min(pixels.x, pixels.y));
+  return mix(color, WIRE_COLOR, edge * wireframe);
+}
+)";
+
+// shades impostors with the color computed by the vertex shader
+const std::string FLAT_FRAGMENT_SHADER = R"(
+#version 330 core
+
+in vec3 Color;
+out vec4 color;
+
+void main() {
+  color = vec4(Color, 1.0);
+}
+)";
+
+Graphics::Graphics(World& world, JobSystem& jobs)
+    : _world(world), _jobs(jobs) {
   resetPosition();
 
   // initialize OpenGL
-  glEnable(GL_DEPTH_TEST);
-  // glEnable(GL_CULL_FACE);
+  // depth, culling, blending and polygon mode are set by the RenderQueue
   glEnable(GL_FRAMEBUFFER_SRGB);
+  glEnable(GL_PROGRAM_POINT_SIZE);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glClearColor(0.3, 0.3, 0.3, 1);
 
@@ -66,10 +281,7 @@ Graphics::Graphics(World& world) : _world(world) {
 
   glBindVertexArray(0);
 
-  _groundShader.loadString(Shader::Vertex, R"(
-#version 330 core
-
-uniform mat4 viewProjection;
+  _groundShader.loadString(Shader::Vertex, FRAME_HEADER + R"(
 layout (location = 0) in vec3 position;
 out vec3 FragPos;
 const float SIZE = 500;
@@ -95,80 +307,178 @@ void main() {
   color = vec4(vec3(0), s * alpha);
 }
 )");
+  _groundShader.bindUniformBlock("Frame", FRAME_BINDING);
 
-  // prepare box
-  glGenVertexArrays(1, &_boxVAO);
+  // prepare box, with a VAO per cube mesh and level of detail
+  glGenVertexArrays(CubeMeshCount * FramePacket::LodCount, _boxVAOs[0]);
   glGenBuffers(1, &_boxVBO);
+  glGenBuffers(1, &_boxEBO);
+  glGenBuffers(1, &_boxArrayVBO);
 
-  glBindVertexArray(_boxVAO);
+  glBindVertexArray(_boxVAOs[IndexedCube][FramePacket::Full]);
 
   glBindBuffer(GL_ARRAY_BUFFER, _boxVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE), CUBE, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxEBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, _boxArrayVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_ARRAY), CUBE_ARRAY,
+               GL_STATIC_DRAW);
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
-                        (GLvoid*)0);
+  for (int mesh = 0; mesh < CubeMeshCount; ++mesh) {
+    for (int lod = 0; lod < FramePacket::LodCount; ++lod) {
+      glBindVertexArray(_boxVAOs[mesh][lod]);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
-                        (GLvoid*)(3 * sizeof(GLfloat)));
+      // impostors are drawn as one point per instance, without a mesh
+      bool impostor = lod == FramePacket::Impostor;
+      if (!impostor && mesh == IndexedCube) {
+        glBindBuffer(GL_ARRAY_BUFFER, _boxVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxEBO);
 
-  glBindVertexArray(0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CubeVertex),
+                              (GLvoid*)offsetof(CubeVertex, position));
 
-  _boxShader.loadString(Shader::Vertex, R"(
-#version 330 core
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                              sizeof(CubeVertex),
+                              (GLvoid*)offsetof(CubeVertex, normal));
+      } else if (!impostor) {
+        glBindBuffer(GL_ARRAY_BUFFER, _boxArrayVBO);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
+                              (GLvoid*)0);
+
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
+                              (GLvoid*)(3 * sizeof(GLfloat)));
+      }
 
-uniform mat4 model;
-uniform mat4 viewProjection;
+      // per-instance transform (up to four attributes, depending on the
+      // InstanceFormat) and color, sourced from the instance stream (see
+      // bindBoxInstances)
+      for (GLuint i = 2; i <= 6; ++i)
+        glVertexAttribDivisor(i, impostor ? 0 : 1);
+    }
+  }
+
+  glBindVertexArray(0);
 
+  // box shaders for each instance format and level of detail
+  for (int format = 0; format < InstanceFormatCount; ++format) {
+    const std::string header = FRAME_HEADER + INSTANCE_INPUTS[format];
+
+    Shader& boxShader = _boxShaders[format][FramePacket::Full];
+    boxShader.loadString(Shader::Vertex, header + WIREFRAME_OUTPUT + R"(
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 
 out vec3 FragPos;
 out vec3 Normal;
+out vec3 ObjectColor;
 
 void main() {
+  outputFaceCoord(position, normal);
+  mat4 model = instanceModel();
   FragPos = vec3(model * vec4(position, 1.0));
   Normal = mat3(model) * normal;
+  ObjectColor = color;
   gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
 )");
-  _boxShader.loadString(Shader::Fragment, R"(
-#version 330 core
-
-uniform vec3 viewPos;
-uniform vec3 objectColor;
-
+    boxShader.loadString(Shader::Fragment, FRAME_HEADER + WIREFRAME_INPUT + R"(
 in vec3 Normal;
 in vec3 FragPos;
+in vec3 ObjectColor;
 out vec4 color;
 
-const vec3 lightPos = vec3(-50, 100, -50);
-const vec3 lightColor = vec3(1, 1, 1);
-const vec3 ambient = 0.1 * lightColor;
 const float specularStrength = 0.5f;
 
 void main() {
+  vec3 ambient = 0.1 * lightColor.rgb;
+
   vec3 normal = normalize(Normal);
-  vec3 lightDir = normalize(lightPos - FragPos);
-  vec3 diffuse = max(dot(normal, lightDir), 0.0) * lightColor;
+  vec3 lightDir = normalize(lightPos.xyz - FragPos);
+  vec3 diffuse = max(dot(normal, lightDir), 0.0) * lightColor.rgb;
 
-  vec3 viewDir = normalize(viewPos - FragPos);
+  vec3 viewDir = normalize(viewPos.xyz - FragPos);
   vec3 reflectDir = reflect(-lightDir, normal);
 
   float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-  vec3 specular = specularStrength * spec * lightColor;
+  vec3 specular = specularStrength * spec * lightColor.rgb;
+
+  vec3 lit = (ambient + diffuse + specular) * ObjectColor;
+  color = vec4(applyWireframe(lit), 1.0f);
+}
+)");
+    boxShader.bindUniformBlock("Frame", FRAME_BINDING);
+
+    // mid range: diffuse lighting per vertex only
+    Shader& simpleShader = _boxShaders[format][FramePacket::Simple];
+    simpleShader.loadString(Shader::Vertex, header + WIREFRAME_OUTPUT + R"(
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+
+out vec3 Color;
+
+void main() {
+  outputFaceCoord(position, normal);
+  mat4 model = instanceModel();
+  vec3 fragPos = vec3(model * vec4(position, 1.0));
+  vec3 lightDir = normalize(lightPos.xyz - fragPos);
+  float diffuse = max(dot(mat3(model) * normal, lightDir), 0.0);
+  Color = (0.1 + diffuse) * lightColor.rgb * color;
+  gl_Position = viewProjection * vec4(fragPos, 1.0);
+}
+)");
+    simpleShader.loadString(Shader::Fragment,
+                            FRAME_HEADER + WIREFRAME_INPUT + R"(
+in vec3 Color;
+out vec4 color;
+
+void main() {
+  color = vec4(applyWireframe(Color), 1.0);
+}
+)");
+    simpleShader.bindUniformBlock("Frame", FRAME_BINDING);
 
-  color = vec4((ambient + diffuse + specular) * objectColor, 1.0f);
+    // far away: a square point sprite about the size of the box, lit as if
+    // it was facing the viewer
+    Shader& impostorShader = _boxShaders[format][FramePacket::Impostor];
+    impostorShader.loadString(Shader::Vertex, header + R"(
+out vec3 Color;
+
+const float BOX_SIZE = 1.0;
+
+void main() {
+  vec3 center = instanceModel()[3].xyz;
+  vec3 normal = normalize(viewPos.xyz - center);
+  vec3 lightDir = normalize(lightPos.xyz - center);
+  float diffuse = max(dot(normal, lightDir), 0.0);
+  Color = (0.1 + diffuse) * lightColor.rgb * color;
+  gl_Position = viewProjection * vec4(center, 1.0);
+  gl_PointSize = max(pointScale * BOX_SIZE / gl_Position.w, 1.0);
 }
 )");
+    impostorShader.loadString(Shader::Fragment, FLAT_FRAGMENT_SHADER);
+    impostorShader.bindUniformBlock("Frame", FRAME_BINDING);
+  }
 }
 
 Graphics::~Graphics() {
   glDeleteVertexArrays(1, &_groundVAO);
   glDeleteBuffers(1, &_groundVBO);
-  glDeleteVertexArrays(1, &_boxVAO);
+  glDeleteVertexArrays(CubeMeshCount * FramePacket::LodCount, _boxVAOs[0]);
   glDeleteBuffers(1, &_boxVBO);
+  glDeleteBuffers(1, &_boxEBO);
+  glDeleteBuffers(1, &_boxArrayVBO);
+  glDeleteBuffers(1, &_culledInstanceVBO);
+  glDeleteBuffers(1, &_drawIndirectBuffer);
+  glDeleteBuffers(1, &_visibleCountBuffer);
+  for (auto& fence : _visibleCountFences)
+    glDeleteSync(fence);
 }
 
 void Graphics::update(float dt) {
@@ -176,6 +486,7 @@ void Graphics::update(float dt) {
   const float SPEED_MOVEMENT = 10.0f;
 
   _shootCoolDown -= dt;
+  _time += dt;
 
   _yaw += _inYaw * dt * SPEED_ROTATION;
   _pitch += _inPitch * dt * SPEED_ROTATION;
@@ -198,41 +509,621 @@ void Graphics::update(float dt) {
   _pos += right * (_inRight * dt * SPEED_MOVEMENT);
 }
 
-void Graphics::render(Window& window) {
-  float aspectRatio = window.getWidth() / window.getHeight();
-  glViewport(0, 0, window.getWidth(), window.getHeight());
+static void packBox(const btTransform& transform, const glm::vec3& color,
+                    const FramePacket& frame, unsigned char* data) {
+  if (frame.instanceFormat == QuantizedInstances) {
+    auto& instance = *reinterpret_cast<QuantizedBoxInstance*>(data);
+    quantizeBox(transform, color, frame.viewPos, instance);
+    return;
+  }
+
+  auto& instance = *reinterpret_cast<BoxInstance*>(data);
+  if (frame.instanceFormat == TransformInstances) {
+    // Bullet's own layout; the vertex shader builds the matrix
+    static_assert(sizeof(btTransform) == sizeof(instance.transform),
+                  "btTransform must be 4 single precision btVector3s");
+    std::memcpy(instance.transform, &transform, sizeof(btTransform));
+  } else {
+    transform.getOpenGLMatrix(&instance.transform[0].x);
+  }
+  instance.color = color;
+}
+
+void Graphics::prepareFrame(FramePacket& frame, int width, int height,
+                            float alpha) {
+  float aspectRatio = static_cast<float>(width) / height;
+  glm::mat4 projection =
+      glm::perspective(glm::radians(45.0f), aspectRatio, 1.0f, 1000.0f);
+
+  frame.width = width;
+  frame.height = height;
+  frame.pointScale = 0.5f * height * projection[1][1];
+  frame.viewProjection = projection * _view;
+  frame.viewPos = _pos;
+  frame.time = _time;
+  frame.wireframe = _wireframe;
+  frame.gpuCulling = _gpuCulling;
+  frame.occlusionCulling = _occlusionCulling;
+  frame.profilerOverlay = _profilerOverlay;
+  frame.pipelineStatistics = _pipelineStatistics;
+  frame.resolution = _resolution;
+  frame.instanceFormat = _instanceFormat;
+  frame.cubeMesh = _cubeMesh;
+
+  frame.totalBoxes = _world.getBoxes().size();
+  if (_gpuCulling) {
+    _visibleBoxes.resize(frame.totalBoxes);
+    std::iota(_visibleBoxes.begin(), _visibleBoxes.end(), 0);
+  } else {
+    cullBoxes(frame.viewProjection);
+  }
+  packBoxes(frame, alpha);
+}
+
+// Collects the boxes in the view frustum by walking the broadphase tree.
+void Graphics::cullBoxes(const glm::mat4& viewProjection) {
+  Frustum frustum(viewProjection);
+  btVector3 normals[Frustum::Count];
+  btScalar offsets[Frustum::Count];
+  for (int i = 0; i < Frustum::Count; ++i) {
+    const glm::vec4& plane = frustum.planes[i];
+    normals[i] = btVector3(plane.x, plane.y, plane.z);
+    offsets[i] = plane.w;
+  }
+  _visibleBoxes.clear();
+  _world.queryVolume(normals, offsets, Frustum::Count, _visibleBoxes);
+}
+
+// Moves a box to another level of detail once it is clearly past one of the
+// LOD_DISTANCES.
+static unsigned char selectLod(unsigned char lod, float distance) {
+  while (lod + 1 < FramePacket::LodCount &&
+         distance > LOD_DISTANCES[lod] * (1.0f + LOD_HYSTERESIS))
+    ++lod;
+  while (lod > 0 &&
+         distance < LOD_DISTANCES[lod - 1] * (1.0f - LOD_HYSTERESIS))
+    --lod;
+  return lod;
+}
+
+// Blends the poses of a box before and after a simulation step.
+static void interpolate(const btTransform& from, const btTransform& to,
+                        float alpha, btTransform& result) {
+  btQuaternion fromRotation, toRotation;
+  from.getBasis().getRotation(fromRotation);
+  to.getBasis().getRotation(toRotation);
+  result.setRotation(fromRotation.slerp(toRotation, alpha));
+  result.setOrigin(from.getOrigin().lerp(to.getOrigin(), alpha));
+}
+
+// Packs the _visibleBoxes into the frame, grouped by level of detail, at
+// `alpha` between their previous and current poses.
+void Graphics::packBoxes(FramePacket& frame, float alpha) {
+  auto& states = _world.getBoxStates();
+  auto& previous = _world.getPreviousPoses();
+  auto& current = _world.getCurrentPoses();
+  _boxLods.resize(current.size(), FramePacket::Full);
+
+  // every box is visible at most once, so the jobs write distinct LODs
+  _jobs.parallelFor(
+      0, _visibleBoxes.size(), PACK_GRAIN, [&](size_t first, size_t last) {
+        for (size_t j = first; j < last; ++j) {
+          int i = _visibleBoxes[j];
+          const btVector3& origin = states.positions[i];
+          float distance = glm::distance(
+              _pos, glm::vec3(origin.x(), origin.y(), origin.z()));
+          _boxLods[i] = selectLod(_boxLods[i], distance);
+        }
+      });
+
+  size_t* counts = frame.lodCounts;
+  std::fill(counts, counts + FramePacket::LodCount, 0);
+  for (int i : _visibleBoxes)
+    ++counts[_boxLods[i]];
+  size_t starts[FramePacket::LodCount], start = 0;
+  for (int lod = 0; lod < FramePacket::LodCount; ++lod) {
+    starts[lod] = start;
+    start += counts[lod];
+  }
+  _packOrder.resize(_visibleBoxes.size());
+  for (int i : _visibleBoxes)
+    _packOrder[starts[_boxLods[i]]++] = i;
+
+  size_t size = instanceSize(frame.instanceFormat);
+  frame.boxes.resize(_packOrder.size() * size);
+  _jobs.parallelFor(
+      0, _packOrder.size(), PACK_GRAIN, [&](size_t first, size_t last) {
+        for (size_t j = first; j < last; ++j) {
+          int i = _packOrder[j];
+          unsigned char* data = &frame.boxes[j * size];
+          // resting boxes, the majority in a settled world, need no blending
+          if (alpha < 1.0f && states.active[i]) {
+            btTransform pose;
+            interpolate(previous[i], current[i], alpha, pose);
+            packBox(pose, states.colors[i], frame, data);
+          } else {
+            packBox(current[i], states.colors[i], frame, data);
+          }
+        }
+      });
+}
+
+void Graphics::render(const FramePacket& frame, GLuint framebuffer) {
+  _profiler.setPipelineStatistics(frame.pipelineStatistics);
+  _profiler.beginFrame();
+  _renderQueue.resetStats();
+
+  // draw the scene at the current resolution scale into its own target
+  updateResolutionScale(frame.resolution);
+  float maxScale = frame.resolution.maxScale;
+  int maxWidth = static_cast<int>(std::ceil(frame.width * maxScale));
+  int maxHeight = static_cast<int>(std::ceil(frame.height * maxScale));
+  _sceneTarget.reserve(maxWidth, maxHeight);
+  int width = std::max(1, static_cast<int>(frame.width * _resolutionScale));
+  int height = std::max(1, static_cast<int>(frame.height * _resolutionScale));
+  GLuint target = _sceneTarget.getFramebuffer();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  glViewport(0, 0, width, height);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(0, 0, width, height);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
 
-  glm::mat4 viewProjections =
-      glm::perspective(glm::radians(45.0f), aspectRatio, 1.0f, 1000.0f) * _view;
+  // per-frame data shared by all programs
+  FrameUniforms uniforms;
+  uniforms.viewProjection = frame.viewProjection;
+  uniforms.viewPos = glm::vec4(frame.viewPos, 1.0f);
+  uniforms.lightPos = glm::vec4(-50.0f, 100.0f, -50.0f, 1.0f);
+  uniforms.lightColor = glm::vec4(1.0f);
+  uniforms.time = frame.time;
+  uniforms.pointScale = frame.pointScale * _resolutionScale;
+  uniforms.wireframe = frame.wireframe ? 1.0f : 0.0f;
+  _frameUniforms.update(uniforms);
 
-  // draw ground
-  _groundShader.use();
-  _groundShader.setUniform("viewProjection", viewProjections);
-  glEnable(GL_BLEND);
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  glBindVertexArray(_groundVAO);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-  glBindVertexArray(0);
-  glDisable(GL_BLEND);
-
-  // draw boxes
-  _boxShader.use();
-  _boxShader.setUniform("viewPos", _pos);
-  _boxShader.setUniform("viewProjection", viewProjections);
-  glPolygonMode(GL_FRONT_AND_BACK, _wireframe ? GL_LINE : GL_FILL);
-  for (auto& box : _world.getBoxes()) {
-    glm::mat4 model;
-    btTransform transform;
-    box.pose->getWorldTransform(transform);
-    transform.getOpenGLMatrix(glm::value_ptr(model));
-
-    _boxShader.setUniform("model", model);
-    _boxShader.setUniform("objectColor", box.color);
-    glBindVertexArray(_boxVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+  // stream the boxes, culling what the simulation thread could not
+  GLintptr offset = 0;
+  if (frame.gpuCulling) {
+    if (!_culledInstanceVBO)
+      initGpuCulling();
+    GpuProfiler::Scope scope(_profiler, "culling");
+    cullBoxesOnGpu(frame);
+    _renderQueue.invalidate(); // program and indirect buffer
+  } else {
+    offset = streamBoxes(frame);
   }
+
+  // boxes, batched by level of detail
+  GLsizeiptr instanceBytes = instanceSize(frame.instanceFormat);
+  GLintptr start = 0;
+  for (int lod = 0; lod < FramePacket::LodCount; ++lod) {
+    DrawPacket box;
+    box.shader = &_boxShaders[frame.instanceFormat][lod];
+    box.vao = _boxVAOs[frame.cubeMesh][lod];
+    bool impostor = lod == FramePacket::Impostor;
+    bool indexed = !impostor && frame.cubeMesh == IndexedCube;
+    if (impostor) {
+      box.mode = GL_POINTS;
+    } else if (indexed) {
+      box.count = CUBE_NUM_INDICES;
+      box.indexType = GL_UNSIGNED_BYTE;
+    } else {
+      box.count = CUBE_ARRAY_NUM_VERTICES;
+      box.state.cullFace = false; // see CUBE_ARRAY
+    }
+
+    if (frame.gpuCulling) {
+      // the compute shader fills in the number of instances
+      size_t boxes = frame.lodCounts[lod];
+      if (boxes == 0)
+        continue;
+      bindBoxInstances(box.vao, frame.instanceFormat, _culledInstanceVBO,
+                       start * instanceBytes);
+      box.kind = indexed ? DrawPacket::ElementsIndirect
+                         : DrawPacket::ArraysIndirect;
+      box.indirectBuffer = _drawIndirectBuffer;
+      box.indirectOffset = CULL_COMMAND_OFFSETS[lod] * sizeof(GLuint);
+      start += boxes;
+    } else {
+      size_t boxes = _stats.lodBoxes[lod];
+      if (boxes == 0)
+        continue;
+      bindBoxInstances(box.vao, frame.instanceFormat,
+                       _boxInstances.getBuffer(),
+                       offset + start * instanceBytes);
+      if (impostor) {
+        box.kind = DrawPacket::Arrays;
+        box.count = boxes;
+      } else {
+        box.kind = indexed ? DrawPacket::Elements : DrawPacket::Arrays;
+        box.instances = boxes;
+      }
+      start += boxes;
+    }
+    _renderQueue.submit(box);
+  }
+  {
+    GpuProfiler::Scope scope(_profiler, "boxes");
+    _renderQueue.flush();
+  }
+
+  // ground, blended over the boxes
+  DrawPacket ground;
+  ground.shader = &_groundShader;
+  ground.vao = _groundVAO;
+  ground.state.blend = true;
+  ground.count = 6;
+  _renderQueue.submit(ground);
+  {
+    GpuProfiler::Scope scope(_profiler, "ground");
+    _renderQueue.flush();
+  }
+
+  // keep this frame's depth for occlusion culling in the next one
+  if (frame.occlusionCulling) {
+    GpuProfiler::Scope scope(_profiler, "hi-z");
+    _depthPyramid.reserve(maxWidth, maxHeight);
+    _depthPyramid.build(target, width, height, frame.viewProjection,
+                        !frame.gpuCulling);
+    _renderQueue.invalidate();
+  }
+
+  {
+    GpuProfiler::Scope scope(_profiler, "upscale");
+    _sceneTarget.present(width, height, framebuffer, frame.width,
+                         frame.height);
+    _renderQueue.invalidate();
+  }
+
+  if (frame.profilerOverlay) {
+    _profiler.drawOverlay(_renderQueue);
+    _renderQueue.flush();
+  }
+  _profiler.endFrame();
+
+  _boxInstances.endFrame();
+}
+
+// Adjusts the resolution scale so that the GPU frame time approaches the
+// target, assuming that it is proportional to the number of pixels drawn.
+void Graphics::updateResolutionScale(const ResolutionSettings& settings) {
+  float scale = settings.dynamic ? _resolutionScale : 1.0f;
+  float frameTime = _profiler.getFrameStats().last;
+  float target = settings.targetFrameTime;
+  if (settings.dynamic && --_resolutionCooldown <= 0 && frameTime > 0.0f &&
+      (frameTime > target || frameTime < 0.8f * target)) {
+    float next = scale * std::sqrt(target / frameTime);
+    next = std::round(next * RESOLUTION_STEPS) / RESOLUTION_STEPS;
+    if (next != scale) {
+      scale = next;
+      _resolutionCooldown = RESOLUTION_COOLDOWN;
+    }
+  }
+  _resolutionScale = glm::clamp(scale, settings.minScale, settings.maxScale);
+}
+
+// Tests the bounds of a box against the previous frames' depth.
+static bool isOccluded(const DepthPyramid& pyramid, const FramePacket& frame,
+                       const unsigned char* data) {
+  if (frame.instanceFormat == QuantizedInstances) {
+    // bounding sphere, rather than decoding the rotation
+    auto& box = *reinterpret_cast<const QuantizedBoxInstance*>(data);
+    glm::vec3 center = frame.viewPos +
+                       glm::vec3(glm::unpackHalf1x16(box.position[0]),
+                                 glm::unpackHalf1x16(box.position[1]),
+                                 glm::unpackHalf1x16(box.position[2]));
+    const glm::vec3 extent(0.8660254f);
+    return pyramid.isOccluded(center - extent, center + extent);
+  }
+
+  const glm::vec4* t = reinterpret_cast<const BoxInstance*>(data)->transform;
+  glm::vec3 center(t[3]);
+  glm::vec3 extent;
+  if (frame.instanceFormat == TransformInstances) {
+    const glm::vec3 one(1.0f);
+    extent = 0.5f * glm::vec3(glm::dot(glm::abs(glm::vec3(t[0])), one),
+                              glm::dot(glm::abs(glm::vec3(t[1])), one),
+                              glm::dot(glm::abs(glm::vec3(t[2])), one));
+  } else {
+    extent = 0.5f * (glm::abs(glm::vec3(t[0])) + glm::abs(glm::vec3(t[1])) +
+                     glm::abs(glm::vec3(t[2])));
+  }
+  return pyramid.isOccluded(center - extent, center + extent);
+}
+
+// Streams the boxes of the frame that are not occluded. Returns the stream
+// offset of the packed instances.
+GLintptr Graphics::streamBoxes(const FramePacket& frame) {
+  _stats.culledBoxes = frame.totalBoxes - frame.getBoxCount();
+  _stats.occludedBoxes = 0;
+  _stats.visibleBoxes = 0;
+  std::fill(std::begin(_stats.lodBoxes), std::end(_stats.lodBoxes), 0);
+  if (frame.boxes.empty())
+    return 0;
+
+  // the boxes stay grouped by level of detail
+  size_t size = instanceSize(frame.instanceFormat);
+  auto instances =
+      static_cast<unsigned char*>(_boxInstances.map(frame.boxes.size()));
+  const unsigned char* box = frame.boxes.data();
+  for (int lod = 0; lod < FramePacket::LodCount; ++lod) {
+    for (size_t i = 0; i < frame.lodCounts[lod]; ++i, box += size) {
+      if (frame.occlusionCulling && isOccluded(_depthPyramid, frame, box)) {
+        ++_stats.occludedBoxes;
+      } else {
+        std::memcpy(instances + _stats.visibleBoxes++ * size, box, size);
+        ++_stats.lodBoxes[lod];
+      }
+    }
+  }
+  return _boxInstances.unmap();
+}
+
+// Streams every box and lets a compute shader compact the visible ones of
+// each level of detail into their range of _culledInstanceVBO, counting them
+// in the draw commands of _drawIndirectBuffer.
+void Graphics::cullBoxesOnGpu(const FramePacket& frame) {
+  readGpuCullingStats();
+
+  auto& boxes = frame.boxes;
+  if (boxes.empty()) {
+    _stats.visibleBoxes = _stats.culledBoxes = _stats.occludedBoxes = 0;
+    std::fill(std::begin(_stats.lodBoxes), std::end(_stats.lodBoxes), 0);
+    return;
+  }
+
+  GLsizeiptr size = boxes.size();
+  void* instances = _boxInstances.map(size, _storageAlignment);
+  std::memcpy(instances, boxes.data(), size);
+  GLintptr offset = _boxInstances.unmap();
+
+  if (size > _culledCapacity) {
+    _culledCapacity = size + size / 2;
+    glBindBuffer(GL_ARRAY_BUFFER, _culledInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, _culledCapacity, nullptr, GL_DYNAMIC_COPY);
+  }
+
+  // reset the draw commands (no instances yet) and the occluded count
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _drawIndirectBuffer);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(CULL_COMMANDS),
+                  CULL_COMMANDS);
+
+  Frustum frustum(frame.viewProjection);
+  _cullShader.use();
+  _cullShader.set(_cullFrustum, frustum.planes, Frustum::Count);
+  size_t numBoxes = frame.getBoxCount();
+  _cullShader.set(_cullNumInstances, static_cast<int>(numBoxes));
+  _cullShader.set(_cullInstanceWords, static_cast<int>(
+                      instanceSize(frame.instanceFormat) / sizeof(GLuint)));
+  _cullShader.set(_cullQuantized,
+                  frame.instanceFormat == QuantizedInstances ? 1 : 0);
+  _cullShader.set(_cullInstanceOrigin, frame.viewPos);
+  const size_t* counts = frame.lodCounts;
+  _cullShader.set(_cullSimpleStart, static_cast<int>(counts[0]));
+  _cullShader.set(_cullImpostorStart, static_cast<int>(counts[0] + counts[1]));
+  bool occlusion = frame.occlusionCulling && _depthPyramid.isValid();
+  _cullShader.set(_cullOcclusion, occlusion ? 1 : 0);
+  if (occlusion) {
+    _cullShader.set(_cullHiZ, 0);
+    _cullShader.set(_cullHiZSize, _depthPyramid.getSize());
+    _cullShader.set(_cullHiZViewProjection, _depthPyramid.getViewProjection());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _depthPyramid.getTexture());
+  }
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, _boxInstances.getBuffer(),
+                    offset, size);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _culledInstanceVBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _drawIndirectBuffer);
+  glDispatchCompute((numBoxes + 63) / 64, 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                  GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  // queue a copy of the commands and occluded count, to be read a few frames
+  // later
+  glBindBuffer(GL_COPY_WRITE_BUFFER, _visibleCountBuffer);
+  glCopyBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                      _visibleCountSlot * sizeof(CULL_COMMANDS),
+                      sizeof(CULL_COMMANDS));
+  _visibleCountFences[_visibleCountSlot] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  _visibleCountTotals[_visibleCountSlot] = numBoxes;
+}
+
+// Reads back the visible count of the oldest GPU culling pass, if it is done.
+void Graphics::readGpuCullingStats() {
+  _visibleCountSlot = (_visibleCountSlot + 1) % GPU_CULLING_LATENCY;
+  GLsync& fence = _visibleCountFences[_visibleCountSlot];
+  if (!fence)
+    return;
+
+  if (glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+    // see CULL_COMMANDS
+    GLuint counts[CULL_NUM_COUNTS];
+    glBindBuffer(GL_COPY_READ_BUFFER, _visibleCountBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER,
+                       _visibleCountSlot * sizeof(counts), sizeof(counts),
+                       counts);
+    _stats.visibleBoxes = 0;
+    for (int lod = 0; lod < FramePacket::LodCount; ++lod) {
+      _stats.lodBoxes[lod] = counts[CULL_VISIBLE_COUNTS[lod]];
+      _stats.visibleBoxes += _stats.lodBoxes[lod];
+    }
+    _stats.occludedBoxes = counts[CULL_OCCLUDED_COUNT];
+    _stats.culledBoxes = _visibleCountTotals[_visibleCountSlot] -
+                         _stats.visibleBoxes - _stats.occludedBoxes;
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+void Graphics::initGpuCulling() {
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &_storageAlignment);
+
+  glGenBuffers(1, &_culledInstanceVBO);
+  glGenBuffers(1, &_drawIndirectBuffer);
+  glGenBuffers(1, &_visibleCountBuffer);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _drawIndirectBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(CULL_COMMANDS), nullptr,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, _visibleCountBuffer);
+  glBufferData(GL_COPY_WRITE_BUFFER,
+               GPU_CULLING_LATENCY * sizeof(CULL_COMMANDS), nullptr,
+               GL_STREAM_READ);
+
+  // instances are read as plain words, as std430 would pad the structs
+  _cullShader.loadString(Shader::Compute, R"(
+#version 430 core
+
+layout (local_size_x = 64) in;
+
+layout (std430, binding = 0) readonly buffer Instances {
+  uint instances[];
+};
+layout (std430, binding = 1) writeonly buffer VisibleInstances {
+  uint visibleInstances[];
+};
+layout (std430, binding = 2) buffer DrawCommands {
+  uint commands[14]; // per level of detail (see CULL_COMMANDS)
+  uint occludedCount;
+};
+
+uniform vec4 frustum[6];
+uniform int numInstances;
+uniform int instanceWords; // size of an instance
+uniform int quantized;     // QuantizedInstances, relative to instanceOrigin
+uniform vec3 instanceOrigin;
+uniform int simpleStart, impostorStart; // instances are grouped by LOD
+
+// hierarchical-Z buffer of the previous frame (see DepthPyramid)
+uniform int occlusion;
+uniform sampler2D hiZ;
+uniform vec2 hiZSize; // built corner of level 0
+uniform mat4 hiZViewProjection;
+
+const float BOX_RADIUS = 0.8660254; // bounding sphere of the unit cube
+const uint VISIBLE_COUNTS[3] = uint[3](1u, 6u, 10u); // in commands
+
+bool isOccluded(vec3 center) {
+  vec3 lo = vec3(1.0), hi = vec3(-1.0);
+  for (int i = 0; i < 8; ++i) {
+    vec3 corner = vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0,
+                       (i & 4) != 0 ? 1.0 : -1.0);
+    vec4 clip = hiZViewProjection * vec4(center + BOX_RADIUS * corner, 1.0);
+    if (clip.w <= 0.0)
+      return false;
+    vec3 ndc = clip.xyz / clip.w;
+    lo = min(lo, ndc);
+    hi = max(hi, ndc);
+  }
+  if (lo.z < -1.0)
+    return false;
+
+  // pick the level where the box spans at most 2x2 texels; the last level
+  // is a single texel
+  vec2 uvLo = clamp(lo.xy * 0.5 + 0.5, 0.0, 1.0);
+  vec2 uvHi = clamp(hi.xy * 0.5 + 0.5, 0.0, 1.0);
+  vec2 extent = (uvHi - uvLo) * hiZSize;
+  int level = min(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))),
+                  textureQueryLevels(hiZ) - 1);
+
+  // the texels within the built corner of that level
+  ivec2 size = max(ivec2(hiZSize) >> level, ivec2(1));
+  ivec2 tLo = min(ivec2(uvLo * vec2(size)), size - 1);
+  ivec2 tHi = min(ivec2(uvHi * vec2(size)), size - 1);
+  float depth = max(max(texelFetch(hiZ, tLo, level).r,
+                        texelFetch(hiZ, ivec2(tHi.x, tLo.y), level).r),
+                    max(texelFetch(hiZ, ivec2(tLo.x, tHi.y), level).r,
+                        texelFetch(hiZ, tHi, level).r));
+  return lo.z * 0.5 + 0.5 > depth;
+}
+
+vec3 instanceCenter(uint src) {
+  if (quantized != 0) {
+    vec2 xy = unpackHalf2x16(instances[src]);
+    float z = unpackHalf2x16(instances[src + 1u]).x;
+    return instanceOrigin + vec3(xy, z);
+  }
+  // the last vec4 of the transform is the origin of the other formats
+  return uintBitsToFloat(uvec3(instances[src + 12u], instances[src + 13u],
+                               instances[src + 14u]));
+}
+
+void main() {
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uint(numInstances))
+    return;
+
+  uint src = id * uint(instanceWords);
+  vec3 center = instanceCenter(src);
+  for (int i = 0; i < 6; ++i) {
+    if (dot(frustum[i].xyz, center) + frustum[i].w < -BOX_RADIUS)
+      return;
+  }
+  if (occlusion != 0 && isOccluded(center)) {
+    atomicAdd(occludedCount, 1u);
+    return;
+  }
+
+  // keep the instances of each level of detail in their own range
+  uint lod = 0u, first = 0u;
+  if (id >= uint(impostorStart)) {
+    lod = 2u;
+    first = uint(impostorStart);
+  } else if (id >= uint(simpleStart)) {
+    lod = 1u;
+    first = uint(simpleStart);
+  }
+  uint slot = atomicAdd(commands[VISIBLE_COUNTS[lod]], 1u);
+  uint dst = (first + slot) * uint(instanceWords);
+  for (uint i = 0u; i < uint(instanceWords); ++i)
+    visibleInstances[dst + i] = instances[src + i];
+}
+)");
+  _cullNumInstances = _cullShader.uniform<int>("numInstances");
+  _cullInstanceWords = _cullShader.uniform<int>("instanceWords");
+  _cullQuantized = _cullShader.uniform<int>("quantized");
+  _cullInstanceOrigin = _cullShader.uniform<glm::vec3>("instanceOrigin");
+  _cullOcclusion = _cullShader.uniform<int>("occlusion");
+  _cullHiZ = _cullShader.uniform<int>("hiZ");
+  _cullSimpleStart = _cullShader.uniform<int>("simpleStart");
+  _cullImpostorStart = _cullShader.uniform<int>("impostorStart");
+  _cullHiZSize = _cullShader.uniform<glm::vec2>("hiZSize");
+  _cullHiZViewProjection = _cullShader.uniform<glm::mat4>("hiZViewProjection");
+  _cullFrustum = _cullShader.uniform<glm::vec4>("frustum");
+}
+
+// Points the instanced attributes of a box VAO at the given instances. The
+// VAO is bound through the render queue, which keeps track of it.
+void Graphics::bindBoxInstances(GLuint vao, InstanceFormat format,
+                                GLuint buffer, GLintptr offset) {
+  _renderQueue.bindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  for (GLuint i = 2; i <= 6; ++i)
+    glEnableVertexAttribArray(i);
+
+  if (format == QuantizedInstances) {
+    const GLsizei stride = sizeof(QuantizedBoxInstance);
+    glVertexAttribPointer(
+        2, 3, GL_HALF_FLOAT, GL_FALSE, stride,
+        (GLvoid*)(offset + offsetof(QuantizedBoxInstance, position)));
+    glVertexAttribIPointer(
+        3, 1, GL_UNSIGNED_INT, stride,
+        (GLvoid*)(offset + offsetof(QuantizedBoxInstance, rotation)));
+    glDisableVertexAttribArray(4);
+    glDisableVertexAttribArray(5);
+    glVertexAttribPointer(
+        6, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+        (GLvoid*)(offset + offsetof(QuantizedBoxInstance, color)));
+    return;
+  }
+
+  for (GLuint i = 0; i < 4; ++i) {
+    glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+                          (GLvoid*)(offset + i * sizeof(glm::vec4)));
+  }
+  glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+                        (GLvoid*)(offset + offsetof(BoxInstance, color)));
 }
 
 void Graphics::inputMovement(float ahead, float right) {
@@ -249,14 +1140,32 @@ void Graphics::shoot() {
   if (_shootCoolDown > 0)
     return;
 
-  World::Box& box = _world.addRandomBox(_pos + _front * 10.0f);
+  World::Handle handle = _world.addRandomBox(_pos + _front * 10.0f);
+  const World::Box& box = _world.getBoxes()[_world.findBox(handle)];
 
   glm::vec3 imp(_front * 60.0f);
   box.body->applyCentralImpulse(btVector3(imp.x, imp.y, imp.z));
 
+  // recycle the oldest shots, so that long sessions don't pile up boxes
+  _shotBoxes.push_back(handle);
+  if (_shotBoxes.size() > MAX_SHOT_BOXES) {
+    _world.removeBox(_shotBoxes.front());
+    _shotBoxes.pop_front();
+  }
+
   _shootCoolDown = 0.2f; // 200ms
 }
 
+void Graphics::despawn() {
+  // the last box shot that is still there
+  while (!_shotBoxes.empty()) {
+    World::Handle handle = _shotBoxes.back();
+    _shotBoxes.pop_back();
+    if (_world.removeBox(handle))
+      break;
+  }
+}
+
 void Graphics::resetPosition() {
   _yaw = -45.0f;
   _pitch = -30.0f;
@@ -266,3 +1175,30 @@ void Graphics::resetPosition() {
 void Graphics::toggleWireframe() {
   _wireframe = !_wireframe;
 }
+
+void Graphics::toggleOcclusionCulling() {
+  _occlusionCulling = !_occlusionCulling;
+}
+
+void Graphics::toggleProfilerOverlay() {
+  _profilerOverlay = !_profilerOverlay;
+}
+
+void Graphics::togglePipelineStatistics() {
+  _pipelineStatistics = !_pipelineStatistics;
+}
+
+void Graphics::toggleDynamicResolution() {
+  _resolution.dynamic = !_resolution.dynamic;
+}
+
+void Graphics::nextInstanceFormat() {
+  _instanceFormat =
+      static_cast<InstanceFormat>((_instanceFormat + 1) % InstanceFormatCount);
+}
+
+void Graphics::toggleGpuCulling() {
+  // requires compute shaders and indirect draws
+  if (GLAD_GL_VERSION_4_3)
+    _gpuCulling = !_gpuCulling;
+}
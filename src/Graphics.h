@@ -1,47 +1,185 @@
 #ifndef _GRAPHICS_H_
 #define _GRAPHICS_H_
 
+#include "DepthPyramid.h"
+#include "FramePacket.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+#include "RenderTarget.h"
 #include "Shader.h"
+#include "StreamBuffer.h"
+#include "UniformBuffer.h"
 #include "Window.h"
 #include "World.h"
+#include <deque>
 
 /*
  * OpenGL scene manager / renderer.
+ *
+ * Camera control and frame preparation run on the simulation thread, while
+ * render() runs on whichever thread owns the GL context (see RenderThread).
+ * The two sides only communicate through FramePackets.
  */
 class Graphics : public InputHandler {
 public:
-  Graphics(World& world);
+  Graphics(World& world, JobSystem& jobs);
   ~Graphics();
 
+  // Simulation thread: moves the camera.
   void update(float dt);
-  void render(Window& window);
+
+  // Simulation thread: captures the camera, settings and the boxes in the
+  // view frustum (or all of them, when culling on the GPU) into `frame`.
+  // The boxes are drawn at `alpha` (0 to 1) of the way from their previous
+  // to their current pose (see World::step).
+  void prepareFrame(FramePacket& frame, int width, int height,
+                    float alpha = 1.0f);
+
+  // Simulation thread: configures dynamic resolution for the next frames.
+  void setResolutionSettings(const ResolutionSettings& settings) {
+    _resolution = settings;
+  }
+
+  // Simulation thread: selects how boxes are streamed to the GPU.
+  void setInstanceFormat(InstanceFormat format) { _instanceFormat = format; }
+
+  // Simulation thread: selects the vertex layout of the boxes.
+  void setCubeMesh(CubeMesh mesh) { _cubeMesh = mesh; }
+
+  // Render thread: draws a frame prepared by prepareFrame() into
+  // `framebuffer` (see Window::getFramebuffer).
+  void render(const FramePacket& frame, GLuint framebuffer);
 
   // InputHandler
   void inputMovement(float ahead, float right) override;
   void inputRotation(float yaw, float pitch) override;
   void shoot() override;
+  void despawn() override;
   void resetPosition() override;
   void toggleWireframe() override;
+  void toggleGpuCulling() override;
+  void toggleOcclusionCulling() override;
+  void toggleProfilerOverlay() override;
+  void togglePipelineStatistics() override;
+  void toggleDynamicResolution() override;
+  void nextInstanceFormat() override;
+
+  // Per-frame rendering statistics. Like the other statistics below, these
+  // are updated by render() and must be read from the render thread; other
+  // threads get them from the RenderThread.
+  struct RenderStats {
+    size_t visibleBoxes = 0;
+    size_t culledBoxes = 0;   // outside of the view frustum
+    size_t occludedBoxes = 0; // hidden behind the previous frame's depth
+    size_t lodBoxes[FramePacket::LodCount] = {}; // visible boxes per tier
+  };
+  const RenderStats& getRenderStats() const { return _stats; }
+
+  // Fraction of the viewport size at which the scene was last drawn.
+  float getResolutionScale() const { return _resolutionScale; }
+
+  // GPU time of the render passes.
+  const GpuProfiler& getGpuProfiler() const { return _profiler; }
+
+  // Draw, state change and bind counts of the last frame.
+  const RenderQueue::Stats& getQueueStats() const {
+    return _renderQueue.getStats();
+  }
+
+  // Statistics of the per-frame instance stream (e.g. GPU stalls).
+  const StreamBuffer::Stats& getStreamStats() const {
+    return _boxInstances.getStats();
+  }
 
 private:
+  void cullBoxes(const glm::mat4& viewProjection);
+  void packBoxes(FramePacket& frame, float alpha);
+  void bindBoxInstances(GLuint vao, InstanceFormat format, GLuint buffer,
+                        GLintptr offset);
+  GLintptr streamBoxes(const FramePacket& frame);
+  void cullBoxesOnGpu(const FramePacket& frame);
+  void readGpuCullingStats();
+  void updateResolutionScale(const ResolutionSettings& settings);
+  void initGpuCulling();
+
   World& _world;
+  JobSystem& _jobs;
 
   // controller
   float _inAhead = 0.0f, _inRight = 0.0f;
   float _inYaw = 0.0f, _inPitch = 0.0f;
   float _shootCoolDown = 0.0f;
+  std::deque<World::Handle> _shotBoxes; // oldest first
 
   // camera
   float _yaw, _pitch;
   glm::vec3 _pos, _front;
   glm::mat4 _view;
 
+  float _time = 0.0f;
+
+  // settings
+  bool _wireframe = false;
+  bool _gpuCulling = false;
+  bool _occlusionCulling = true;
+  bool _profilerOverlay = false;
+  bool _pipelineStatistics = false;
+  ResolutionSettings _resolution;
+  InstanceFormat _instanceFormat = TransformInstances;
+  CubeMesh _cubeMesh = IndexedCube;
+  std::vector<int> _visibleBoxes;
+  // FramePacket::Lod of each World box; when a removal moves a box to
+  // another index, its next selectLod starts from the LOD found there
+  std::vector<unsigned char> _boxLods;
+  std::vector<int> _packOrder;         // _visibleBoxes in FramePacket order
+
+  // per-frame data, bound to every program as uniform block "Frame"
+  static constexpr GLuint FRAME_BINDING = 0;
+  struct FrameUniforms { // std140
+    glm::mat4 viewProjection;
+    glm::vec4 viewPos;
+    glm::vec4 lightPos;
+    glm::vec4 lightColor;
+    float time;
+    float pointScale;
+    float wireframe;
+    float padding;
+  };
+  UniformBuffer<FrameUniforms> _frameUniforms{FRAME_BINDING};
+
   // OpenGL state
+  RenderQueue _renderQueue;
+  GpuProfiler _profiler;
+  RenderTarget _sceneTarget;
+  float _resolutionScale = 1.0f;
+  int _resolutionCooldown = 0; // frames until the scale may change again
   Shader _groundShader;
   GLuint _groundVAO = 0, _groundVBO = 0;
-  Shader _boxShader;
-  GLuint _boxVAO = 0, _boxVBO = 0;
-  bool _wireframe = false;
+  Shader _boxShaders[InstanceFormatCount][FramePacket::LodCount];
+  GLuint _boxVAOs[CubeMeshCount][FramePacket::LodCount] = {};
+  GLuint _boxVBO = 0, _boxEBO = 0, _boxArrayVBO = 0;
+  StreamBuffer _boxInstances{GL_ARRAY_BUFFER};
+  RenderStats _stats;
+  DepthPyramid _depthPyramid;
+
+  // GPU-driven culling (GL 4.3+)
+  static constexpr int GPU_CULLING_LATENCY = 3; // frames until stats are read
+  Shader _cullShader;
+  Shader::Uniform<int> _cullNumInstances, _cullOcclusion, _cullHiZ;
+  Shader::Uniform<int> _cullInstanceWords, _cullQuantized;
+  Shader::Uniform<glm::vec3> _cullInstanceOrigin;
+  Shader::Uniform<int> _cullSimpleStart, _cullImpostorStart;
+  Shader::Uniform<glm::vec2> _cullHiZSize;
+  Shader::Uniform<glm::mat4> _cullHiZViewProjection;
+  Shader::Uniform<glm::vec4> _cullFrustum;
+  GLint _storageAlignment = 1; // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+  GLuint _culledInstanceVBO = 0, _drawIndirectBuffer = 0;
+  GLsizeiptr _culledCapacity = 0;
+  GLuint _visibleCountBuffer = 0;
+  GLsync _visibleCountFences[GPU_CULLING_LATENCY] = {};
+  size_t _visibleCountTotals[GPU_CULLING_LATENCY] = {};
+  int _visibleCountSlot = 0;
 };
 
 #endif // _GRAPHICS_H_
@@ -0,0 +1,191 @@
+#include "JobSystem.h"
+
+namespace {
+// pool and deque of the current thread, if it is a worker
+struct WorkerThread {
+  const JobSystem* system = nullptr;
+  int index = 0;
+};
+thread_local WorkerThread t_worker;
+}
+
+JobSystem::JobSystem(int numThreads) {
+  if (numThreads <= 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 0; i < numThreads; ++i)
+    _queues.emplace_back(new Queue());
+  _numThreads = numThreads;
+  _stats.reset(new Stats[numThreads]);
+  _statsStart = clock::now().time_since_epoch().count();
+
+  // the calling threads use the first deque
+  for (int i = 1; i < numThreads; ++i)
+    _workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(_wakeMutex);
+    _quit = true;
+  }
+  _wake.notify_all();
+  for (auto& worker : _workers)
+    worker.join();
+}
+
+void JobSystem::setNumThreads(int numThreads) {
+  numThreads = std::max(1, std::min(numThreads, getMaxNumThreads()));
+  {
+    std::lock_guard<std::mutex> lock(_wakeMutex);
+    _numThreads = numThreads;
+  }
+  _wake.notify_all();
+}
+
+int JobSystem::getThreadIndex() const {
+  return t_worker.system == this ? t_worker.index : 0;
+}
+
+void JobSystem::run(Job job, Counter& counter, Counter* dependency) {
+  ++counter._pending;
+  Task task{std::move(job), &counter};
+  if (dependency) {
+    std::lock_guard<std::mutex> lock(dependency->_mutex);
+    if (dependency->_pending.load() > 0) {
+      dependency->_dependents.push_back(std::move(task));
+      return;
+    }
+  }
+  push(std::move(task));
+}
+
+void JobSystem::wait(Counter& counter) {
+  int index = getThreadIndex();
+  Task task;
+  while (!counter.isDone()) {
+    if (pop(index, task))
+      execute(index, task);
+    else
+      std::this_thread::yield();
+  }
+  // the job that finished last may still be releasing the dependents
+  std::lock_guard<std::mutex> lock(counter._mutex);
+}
+
+void JobSystem::push(Task task) {
+  Queue& queue = *_queues[getThreadIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    ++_queued;
+  }
+  // a worker about to sleep holds _wakeMutex until it waits, so it can't
+  // miss the notification
+  { std::lock_guard<std::mutex> lock(_wakeMutex); }
+  _wake.notify_one();
+}
+
+// Takes the newest job of the thread's own deque, or else steals the oldest
+// job of another one.
+bool JobSystem::pop(int index, Task& task) {
+  if (_queued.load() == 0)
+    return false;
+
+  {
+    Queue& queue = *_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      --_queued;
+      return true;
+    }
+  }
+
+  int numThreads = getNumThreads();
+  for (int i = 1; i < numThreads; ++i) {
+    Queue& victim = *_queues[(index + i) % numThreads];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --_queued;
+      ++_stats[index].steals;
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::execute(int index, Task& task) {
+  auto start = clock::now();
+  task.job();
+  auto busy = clock::now() - start;
+
+  Stats& stats = _stats[index];
+  ++stats.jobs;
+  stats.busyNanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count();
+
+  task.job = nullptr;
+  finish(*task.counter);
+}
+
+// Counts a job of `counter` as done, and queues the jobs depending on it once
+// all are.
+void JobSystem::finish(Counter& counter) {
+  std::vector<Task> dependents;
+  {
+    std::lock_guard<std::mutex> lock(counter._mutex);
+    if (--counter._pending == 0)
+      dependents.swap(counter._dependents);
+  }
+  for (auto& task : dependents)
+    push(std::move(task));
+}
+
+void JobSystem::workerLoop(int index) {
+  t_worker.system = this;
+  t_worker.index = index;
+
+  Task task;
+  while (true) {
+    if (index < _numThreads.load() && pop(index, task)) {
+      execute(index, task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(_wakeMutex);
+    _wake.wait(lock, [&] {
+      return _quit || (_queued.load() > 0 && index < _numThreads.load());
+    });
+    if (_quit && (_queued.load() == 0 || index >= _numThreads.load()))
+      return;
+  }
+}
+
+std::vector<JobSystem::ThreadStats> JobSystem::getStats() const {
+  clock::time_point start{clock::duration(_statsStart.load())};
+  double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  std::vector<ThreadStats> result(getMaxNumThreads());
+  for (size_t i = 0; i < result.size(); ++i) {
+    const Stats& stats = _stats[i];
+    ThreadStats& thread = result[i];
+    thread.jobs = stats.jobs;
+    thread.steals = stats.steals;
+    thread.busySeconds = stats.busyNanoseconds * 1e-9;
+    if (elapsed > 0.0)
+      thread.utilization = thread.busySeconds / elapsed;
+  }
+  return result;
+}
+
+void JobSystem::resetStats() {
+  for (int i = 0; i < getMaxNumThreads(); ++i) {
+    _stats[i].jobs = 0;
+    _stats[i].steals = 0;
+    _stats[i].busyNanoseconds = 0;
+  }
+  _statsStart = clock::now().time_since_epoch().count();
+}
@@ -0,0 +1,146 @@
+#ifndef _JOBSYSTEM_H_
+#define _JOBSYSTEM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing thread pool shared by the whole engine.
+ *
+ * Every worker has its own deque: it runs its newest jobs first and, when it
+ * runs dry, steals the oldest jobs of the others. Threads that aren't
+ * workers (e.g. the simulation thread) share one more deque, and help
+ * running jobs while they wait for them, so they are counted as a thread of
+ * the pool too.
+ *
+ * Jobs are grouped by Counters, which can be waited on and which other jobs
+ * can depend on.
+ */
+class JobSystem {
+public:
+  using Job = std::function<void()>;
+
+  // Number of unfinished jobs run() with it.
+  class Counter {
+  public:
+    Counter() = default;
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    bool isDone() const { return _pending.load() == 0; }
+
+  private:
+    friend class JobSystem;
+    struct Task {
+      Job job;
+      Counter* counter;
+    };
+
+    std::atomic<int> _pending{0};
+    std::mutex _mutex;            // guards _dependents
+    std::vector<Task> _dependents; // to run once _pending gets to 0
+  };
+
+  // Runs on `numThreads` threads in total: the calling threads and
+  // numThreads - 1 workers. 0 means one per hardware thread.
+  explicit JobSystem(int numThreads = 0);
+  // Waits for the workers to finish their queued jobs.
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  // Threads that run jobs, at most getMaxNumThreads().
+  int getNumThreads() const { return _numThreads.load(); }
+  int getMaxNumThreads() const { return static_cast<int>(_queues.size()); }
+
+  // Lets only the first `numThreads` threads (clamped to 1 to
+  // getMaxNumThreads()) run jobs; the other workers sleep. Only while no
+  // jobs are queued.
+  void setNumThreads(int numThreads);
+
+  // Queues `job`, counted by `counter`. With a `dependency`, the job is only
+  // queued once all jobs counted by it are done.
+  void run(Job job, Counter& counter, Counter* dependency = nullptr);
+
+  // Runs queued jobs until all jobs counted by `counter` are done.
+  void wait(Counter& counter);
+
+  // Calls body(first, last) for consecutive ranges of at most `grainSize`
+  // indices that together cover [begin, end), in parallel, and returns once
+  // all are done.
+  template <typename Body>
+  void parallelFor(size_t begin, size_t end, size_t grainSize,
+                   const Body& body) {
+    grainSize = std::max<size_t>(grainSize, 1);
+    if (end - begin <= grainSize || getNumThreads() == 1) {
+      if (begin < end)
+        body(begin, end);
+      return;
+    }
+    Counter counter;
+    for (size_t first = begin; first < end; first += grainSize) {
+      size_t last = std::min(first + grainSize, end);
+      run([&body, first, last] { body(first, last); }, counter);
+    }
+    wait(counter);
+  }
+
+  // Per thread statistics since the pool started or resetStats(), the
+  // calling threads first, for all getMaxNumThreads() threads.
+  struct ThreadStats {
+    uint64_t jobs = 0;   // run
+    uint64_t steals = 0; // jobs taken from another thread's deque
+    double busySeconds = 0.0;
+    double utilization = 0.0; // busy fraction of the time
+  };
+  std::vector<ThreadStats> getStats() const;
+  void resetStats();
+
+private:
+  using Task = Counter::Task;
+  using clock = std::chrono::steady_clock;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  struct Stats {
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> busyNanoseconds{0};
+    char padding[40]; // keeps threads off each other's cache lines
+  };
+
+  int getThreadIndex() const;
+  void push(Task task);
+  bool pop(int index, Task& task);
+  void execute(int index, Task& task);
+  void finish(Counter& counter);
+  void workerLoop(int index);
+
+private:
+  std::vector<std::unique_ptr<Queue>> _queues; // per thread, callers first
+  std::atomic<int> _numThreads;                // running jobs
+  std::unique_ptr<Stats[]> _stats;             // per thread
+  std::atomic<clock::rep> _statsStart;
+  std::vector<std::thread> _workers;
+
+  // idle workers sleep until jobs are queued
+  std::atomic<int> _queued{0};
+  std::mutex _wakeMutex;
+  std::condition_variable _wake;
+  bool _quit = false; // guarded by _wakeMutex
+};
+
+#endif // _JOBSYSTEM_H_
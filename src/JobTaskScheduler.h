@@ -0,0 +1,66 @@
+#ifndef _JOBTASKSCHEDULER_H_
+#define _JOBTASKSCHEDULER_H_
+
+#include "JobSystem.h"
+#include <LinearMath/btThreads.h>
+
+/*
+ * Runs Bullet's parallel loops on a JobSystem, so that the simulation shares
+ * the engine's threads instead of starting its own (see btSetTaskScheduler).
+ * The number of threads is the JobSystem's.
+ *
+ * Bullet numbers every thread that runs its code once, for good, with a
+ * process-wide counter (btGetCurrentThreadIndex), and sizes per-thread data
+ * by getNumThreads(). So the same JobSystem has to serve all dynamics
+ * worlds, only ever growing the number of threads taking part, and no more
+ * than BT_MAX_THREAD_COUNT of them: the scheduler limits the JobSystem to
+ * that many.
+ */
+class JobTaskScheduler : public btITaskScheduler {
+public:
+  explicit JobTaskScheduler(JobSystem& jobs)
+      : btITaskScheduler("JobSystem"), _jobs(jobs) {
+    if (_jobs.getNumThreads() > BT_MAX_THREAD_COUNT)
+      _jobs.setNumThreads(BT_MAX_THREAD_COUNT);
+  }
+
+  int getMaxNumThreads() const override {
+    return std::min(_jobs.getMaxNumThreads(), int(BT_MAX_THREAD_COUNT));
+  }
+  int getNumThreads() const override {
+    return std::min(_jobs.getNumThreads(), int(BT_MAX_THREAD_COUNT));
+  }
+  void setNumThreads(int numThreads) override {
+    _jobs.setNumThreads(std::min(numThreads, int(BT_MAX_THREAD_COUNT)));
+  }
+
+  void parallelFor(int iBegin, int iEnd, int grainSize,
+                   const btIParallelForBody& body) override {
+    _jobs.parallelFor(iBegin, iEnd, grainSize, [&](size_t first, size_t last) {
+      body.forLoop(static_cast<int>(first), static_cast<int>(last));
+    });
+  }
+
+  btScalar parallelSum(int iBegin, int iEnd, int grainSize,
+                       const btIParallelSumBody& body) override {
+    // a partial sum per range, added up in order
+    size_t grain = std::max(grainSize, 1);
+    std::vector<btScalar> sums((iEnd - iBegin + grain - 1) / grain);
+    _jobs.parallelFor(0, sums.size(), 1, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        int begin = iBegin + static_cast<int>(i * grain);
+        int end = std::min(begin + static_cast<int>(grain), iEnd);
+        sums[i] = body.sumLoop(begin, end);
+      }
+    });
+    btScalar sum = 0;
+    for (btScalar partial : sums)
+      sum += partial;
+    return sum;
+  }
+
+private:
+  JobSystem& _jobs;
+};
+
+#endif // _JOBTASKSCHEDULER_H_
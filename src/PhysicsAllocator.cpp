@@ -0,0 +1,243 @@
+#include "PhysicsAllocator.h"
+#include <LinearMath/btAlignedAllocator.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+
+namespace {
+// in front of every block
+struct Header {
+  uint64_t size;      // as requested
+  uint16_t sizeClass; // LARGE for blocks from malloc
+  uint16_t category;
+  uint16_t offset;    // of a large block from the start of its allocation
+  uint16_t alignment; // of a large block
+};
+static_assert(sizeof(Header) == 16, "blocks must stay 16-byte aligned");
+
+// block sizes, including the header
+const size_t CLASS_SIZES[] = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+const int CLASS_COUNT = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+const uint16_t LARGE = 0xffff;
+const size_t ALIGNMENT = 16; // of the blocks in size classes
+
+const size_t REGION_SIZE = 2 << 20; // a huge page
+const size_t CHUNK_SIZE = 64 << 10; // taken from a region at a time
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct SizeClass {
+  std::mutex mutex;
+  FreeBlock* free = nullptr;
+  char* next = nullptr; // rest of the chunk, not handed out yet
+  char* end = nullptr;
+};
+
+struct Counters {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> blocks{0};
+  std::atomic<uint64_t> totalAllocations{0};
+};
+
+struct State {
+  SizeClass classes[CLASS_COUNT];
+  Counters counters[PhysicsAllocator::CategoryCount];
+  std::atomic<uint64_t> reservedBytes{0};
+
+  std::mutex regionMutex; // guards the fields below
+  bool hugePages = false;
+  char* region = nullptr; // rest of the current region
+  char* regionEnd = nullptr;
+};
+
+// never destroyed, since Bullet may still free memory at exit
+State* s_state = nullptr;
+std::atomic<int> s_category{PhysicsAllocator::Setup};
+
+inline auto getLogger() {
+  static std::shared_ptr<spdlog::logger> s_logger;
+  if (!s_logger)
+    s_logger = spdlog::stdout_logger_mt("memory", true /*use color*/);
+  return s_logger;
+}
+
+// Maps a region aligned to its size, so that the kernel can back it with
+// transparent huge pages when explicit ones aren't available.
+char* mapRegion(bool& hugePages) {
+#ifdef MAP_HUGETLB
+  if (hugePages) {
+    void* region = mmap(nullptr, REGION_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED)
+      return static_cast<char*>(region);
+    getLogger()->warn() << "No huge pages reserved (see vm.nr_hugepages), "
+                           "using transparent huge pages";
+    hugePages = false;
+  }
+#endif
+
+  void* mapping = mmap(nullptr, 2 * REGION_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED)
+    return nullptr;
+  char* start = static_cast<char*>(mapping);
+  char* region = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(start) + REGION_SIZE - 1) &
+      ~(REGION_SIZE - 1));
+  if (region > start)
+    munmap(start, region - start);
+  munmap(region + REGION_SIZE, start + REGION_SIZE - region);
+#ifdef MADV_HUGEPAGE
+  madvise(region, REGION_SIZE, MADV_HUGEPAGE);
+#endif
+  return region;
+}
+
+// Hands out a block of the size class, refilling it from a region if needed.
+void* allocateSmall(State& state, int index) {
+  SizeClass& sizeClass = state.classes[index];
+  std::lock_guard<std::mutex> lock(sizeClass.mutex);
+  if (FreeBlock* block = sizeClass.free) {
+    sizeClass.free = block->next;
+    return block;
+  }
+
+  size_t size = CLASS_SIZES[index];
+  if (static_cast<size_t>(sizeClass.end - sizeClass.next) < size) {
+    std::lock_guard<std::mutex> regionLock(state.regionMutex);
+    if (state.region == state.regionEnd) {
+      state.region = mapRegion(state.hugePages);
+      if (!state.region) {
+        state.regionEnd = nullptr;
+        return nullptr;
+      }
+      state.regionEnd = state.region + REGION_SIZE;
+      state.reservedBytes += REGION_SIZE;
+    }
+    // the end of the previous chunk is lost, less than a block
+    sizeClass.next = state.region;
+    sizeClass.end = state.region + CHUNK_SIZE;
+    state.region += CHUNK_SIZE;
+  }
+  void* block = sizeClass.next;
+  sizeClass.next += size;
+  return block;
+}
+
+void* allocate(size_t size, int alignment) {
+  State& state = *s_state;
+  int category = s_category.load(std::memory_order_relaxed);
+  size_t total = size + sizeof(Header);
+
+  Header* header;
+  if (static_cast<size_t>(alignment) <= ALIGNMENT &&
+      total <= CLASS_SIZES[CLASS_COUNT - 1]) {
+    int index = 0;
+    while (CLASS_SIZES[index] < total)
+      ++index;
+    header = static_cast<Header*>(allocateSmall(state, index));
+    if (!header)
+      return nullptr;
+    header->sizeClass = index;
+  } else {
+    // malloc aligns to 16, so this leaves room for the header in front of
+    // an aligned block
+    size_t align = std::max<size_t>(alignment, ALIGNMENT);
+    char* start = static_cast<char*>(std::malloc(size + align));
+    if (!start)
+      return nullptr;
+    uintptr_t block =
+        (reinterpret_cast<uintptr_t>(start) + sizeof(Header) + align - 1) &
+        ~(align - 1);
+    header = reinterpret_cast<Header*>(block) - 1;
+    header->sizeClass = LARGE;
+    header->offset = block - reinterpret_cast<uintptr_t>(start);
+    header->alignment = align;
+    state.reservedBytes += size + align;
+  }
+  header->size = size;
+  header->category = category;
+
+  Counters& counters = state.counters[category];
+  counters.bytes += size;
+  ++counters.blocks;
+  ++counters.totalAllocations;
+  return header + 1;
+}
+
+void deallocate(void* block) {
+  if (!block)
+    return;
+  State& state = *s_state;
+  Header* header = static_cast<Header*>(block) - 1;
+
+  Counters& counters = state.counters[header->category];
+  counters.bytes -= header->size;
+  --counters.blocks;
+
+  if (header->sizeClass == LARGE) {
+    state.reservedBytes -= header->size + header->alignment;
+    std::free(static_cast<char*>(block) - header->offset);
+    return;
+  }
+  SizeClass& sizeClass = state.classes[header->sizeClass];
+  std::lock_guard<std::mutex> lock(sizeClass.mutex);
+  FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(header);
+  freeBlock->next = sizeClass.free;
+  sizeClass.free = freeBlock;
+}
+
+void* allocateUnaligned(size_t size) {
+  return allocate(size, ALIGNMENT);
+}
+}
+
+const char* const CATEGORY_NAMES[] = {"setup", "bodies", "simulation",
+                                      "queries"};
+
+const char* PhysicsAllocator::getCategoryName(Category category) {
+  return CATEGORY_NAMES[category];
+}
+
+void PhysicsAllocator::install(bool hugePages) {
+  static std::once_flag s_installed;
+  std::call_once(s_installed, [hugePages] {
+    s_state = new State();
+    s_state->hugePages = hugePages;
+    btAlignedAllocSetCustom(allocateUnaligned, deallocate);
+    btAlignedAllocSetCustomAligned(allocate, deallocate);
+  });
+}
+
+bool PhysicsAllocator::isInstalled() {
+  return s_state != nullptr;
+}
+
+PhysicsAllocator::Scope::Scope(Category category) {
+  _previous = static_cast<Category>(s_category.exchange(category));
+}
+
+PhysicsAllocator::Scope::~Scope() {
+  s_category = _previous;
+}
+
+PhysicsAllocator::Stats PhysicsAllocator::getStats() {
+  Stats stats;
+  if (!s_state)
+    return stats;
+  for (int i = 0; i < CategoryCount; ++i) {
+    const Counters& counters = s_state->counters[i];
+    stats.categories[i].bytes = counters.bytes;
+    stats.categories[i].blocks = counters.blocks;
+    stats.categories[i].totalAllocations = counters.totalAllocations;
+  }
+  stats.reservedBytes = s_state->reservedBytes;
+  std::lock_guard<std::mutex> lock(s_state->regionMutex);
+  stats.hugePages = s_state->hugePages;
+  return stats;
+}
@@ -0,0 +1,63 @@
+#ifndef _PHYSICSALLOCATOR_H_
+#define _PHYSICSALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Memory for Bullet, installed through its btAlignedAllocSetCustom hooks.
+ *
+ * Small blocks come from free lists per size class, carved out of 2 MiB
+ * regions that are kept for the whole session, so the simulation reuses the
+ * same memory as contacts and islands come and go instead of fragmenting
+ * the heap. Larger blocks go to malloc. Regions can be backed by huge pages.
+ *
+ * Every block is counted under the Category in effect when it was allocated
+ * (see Scope), which makes physics memory and its churn visible at runtime.
+ */
+class PhysicsAllocator {
+public:
+  enum Category {
+    Setup,      // dynamics world, shapes and ground
+    Bodies,     // box bodies and motion states
+    Simulation, // stepping: contacts, islands, solver data
+    Queries,    // broadphase queries
+    CategoryCount
+  };
+  static const char* getCategoryName(Category category);
+
+  // Routes all of Bullet's allocations to this allocator. Bullet must not
+  // have allocated anything before; later calls do nothing. Without huge
+  // page support, regions use regular pages.
+  static void install(bool hugePages = false);
+  static bool isInstalled();
+
+  // Counts the allocations made while it exists, on any thread, under
+  // `category`. Meant for the simulation thread, whose jobs allocate under
+  // the same category.
+  class Scope {
+  public:
+    explicit Scope(Category category);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Category _previous;
+  };
+
+  struct CategoryStats {
+    uint64_t bytes = 0;            // live, as requested
+    uint64_t blocks = 0;           // live
+    uint64_t totalAllocations = 0; // since installed, for allocation rates
+  };
+  struct Stats {
+    CategoryStats categories[CategoryCount];
+    uint64_t reservedBytes = 0; // regions and large blocks
+    bool hugePages = false;     // regions are backed by huge pages
+  };
+  static Stats getStats();
+};
+
+#endif // _PHYSICSALLOCATOR_H_
@@ -0,0 +1,98 @@
+#include "Png.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+namespace {
+uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler) {
+  uint32_t a = adler & 0xFFFF, b = adler >> 16;
+  for (size_t i = 0; i < size; ++i) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return b << 16 | a;
+}
+
+void putBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+void writeChunk(std::ofstream& file, const char* type,
+                const std::vector<unsigned char>& data) {
+  std::vector<unsigned char> chunk;
+  putBigEndian(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+  file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+} // namespace
+
+bool writePng(const std::string& fileName, int width, int height,
+              const std::vector<unsigned char>& pixels) {
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file)
+    return false;
+
+  const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+                                     '\n'};
+  file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+  // 8 bits per channel, RGBA, no interlacing
+  std::vector<unsigned char> header;
+  putBigEndian(header, width);
+  putBigEndian(header, height);
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+  writeChunk(file, "IHDR", header);
+
+  // scanlines without filtering
+  size_t stride = width * 4;
+  std::vector<unsigned char> raw;
+  raw.reserve((stride + 1) * height);
+  for (int y = 0; y < height; ++y) {
+    raw.push_back(0);
+    auto row = pixels.begin() + y * stride;
+    raw.insert(raw.end(), row, row + stride);
+  }
+
+  // zlib stream of stored (uncompressed) deflate blocks
+  std::vector<unsigned char> data = {0x78, 0x01};
+  for (size_t offset = 0; offset < raw.size() || offset == 0;) {
+    size_t size = std::min<size_t>(raw.size() - offset, 0xFFFF);
+    bool last = offset + size == raw.size();
+    data.push_back(last ? 1 : 0);
+    data.push_back(size & 0xFF);
+    data.push_back(size >> 8);
+    data.push_back(~size & 0xFF);
+    data.push_back((~size >> 8) & 0xFF);
+    data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+    offset += size;
+    if (last)
+      break;
+  }
+  putBigEndian(data, adler32(raw.data(), raw.size(), 1));
+  writeChunk(file, "IDAT", data);
+
+  writeChunk(file, "IEND", {});
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,12 @@
+#ifndef _PNG_H_
+#define _PNG_H_
+
+#include <string>
+#include <vector>
+
+// Writes 8-bit RGBA pixels, top row first, as an uncompressed PNG file.
+// Returns false if the file can't be written.
+bool writePng(const std::string& fileName, int width, int height,
+              const std::vector<unsigned char>& pixels);
+
+#endif // _PNG_H_
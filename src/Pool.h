@@ -0,0 +1,96 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <LinearMath/btAlignedAllocator.h>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Storage for many objects of one type, in chunks of CHUNK_SIZE contiguous
+ * slots, so that objects created one after another lie next to each other
+ * in memory instead of wherever the heap finds room.
+ *
+ * Slots of destroyed objects are reused by the next ones created. Chunks
+ * are only freed with the pool. They come from Bullet's allocator, 16-byte
+ * aligned as its SIMD types need.
+ */
+template <typename T, size_t CHUNK_SIZE = 256>
+class Pool {
+public:
+  static constexpr size_t ALIGNMENT = 16;
+  static_assert(alignof(T) <= ALIGNMENT, "T needs a larger alignment");
+
+  Pool() = default;
+  // Frees the chunks; all objects must have been destroyed.
+  ~Pool() {
+    for (void* chunk : _chunks)
+      btAlignedFree(chunk);
+  }
+
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  template <typename... Args>
+  T* create(Args&&... args) {
+    if (!_free)
+      addChunk();
+    Slot* slot = _free;
+    _free = slot->next;
+    try {
+      T* object = ::new (static_cast<void*>(slot))
+          T(std::forward<Args>(args)...);
+      ++_size;
+      return object;
+    } catch (...) {
+      slot->next = _free;
+      _free = slot;
+      throw;
+    }
+  }
+
+  void destroy(T* object) {
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = _free;
+    _free = slot;
+    --_size;
+  }
+
+  // live objects
+  size_t size() const { return _size; }
+  // slots allocated
+  size_t capacity() const { return _chunks.size() * CHUNK_SIZE; }
+
+private:
+  // a free slot holds the next free one
+  struct Slot {
+    Slot* next;
+  };
+  static constexpr size_t SLOT_SIZE =
+      (std::max(sizeof(T), sizeof(Slot)) + ALIGNMENT - 1) / ALIGNMENT *
+      ALIGNMENT;
+
+  void addChunk() {
+    auto chunk = static_cast<unsigned char*>(
+        btAlignedAlloc(CHUNK_SIZE * SLOT_SIZE, ALIGNMENT));
+    if (!chunk)
+      throw std::bad_alloc();
+    _chunks.push_back(chunk);
+    // hand out the slots in address order
+    for (size_t i = CHUNK_SIZE; i-- > 0;) {
+      Slot* slot = reinterpret_cast<Slot*>(chunk + i * SLOT_SIZE);
+      slot->next = _free;
+      _free = slot;
+    }
+  }
+
+private:
+  std::vector<void*> _chunks;
+  Slot* _free = nullptr;
+  size_t _size = 0;
+};
+
+#endif // _POOL_H_
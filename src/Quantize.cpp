@@ -0,0 +1,69 @@
+#include "Quantize.h"
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+
+// range and resolution of the three smallest quaternion components
+const float QUATERNION_RANGE = 0.70710678f;
+const uint32_t QUATERNION_STEPS = 1023;
+
+void quantizeBox(const btTransform& transform, const glm::vec3& color,
+                 const glm::vec3& origin, QuantizedBoxInstance& instance) {
+  const btVector3& position = transform.getOrigin();
+  instance.position[0] = glm::packHalf1x16(position.x() - origin.x);
+  instance.position[1] = glm::packHalf1x16(position.y() - origin.y);
+  instance.position[2] = glm::packHalf1x16(position.z() - origin.z);
+  instance.position[3] = 0;
+
+  btQuaternion rotation;
+  transform.getBasis().getRotation(rotation);
+  const float q[] = {rotation.x(), rotation.y(), rotation.z(), rotation.w()};
+  uint32_t largest = 0;
+  for (uint32_t i = 1; i < 4; ++i) {
+    if (std::abs(q[i]) > std::abs(q[largest]))
+      largest = i;
+  }
+  // q and -q are the same rotation; pick the one with a positive largest
+  // component, so that it can be restored from the others
+  float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+  uint32_t bits = largest << 30;
+  for (uint32_t i = 0, shift = 0; i < 4; ++i) {
+    if (i == largest)
+      continue;
+    float value = glm::clamp(sign * q[i], -QUATERNION_RANGE, QUATERNION_RANGE);
+    float unit = (value + QUATERNION_RANGE) / (2.0f * QUATERNION_RANGE);
+    bits |= static_cast<uint32_t>(std::round(unit * QUATERNION_STEPS))
+            << shift;
+    shift += 10;
+  }
+  instance.rotation = bits;
+
+  instance.color = glm::packUnorm4x8(glm::vec4(color, 1.0f));
+}
+
+void dequantizeBox(const QuantizedBoxInstance& instance,
+                   const glm::vec3& origin, btTransform& transform,
+                   glm::vec3& color) {
+  transform.setOrigin(
+      btVector3(origin.x + glm::unpackHalf1x16(instance.position[0]),
+                origin.y + glm::unpackHalf1x16(instance.position[1]),
+                origin.z + glm::unpackHalf1x16(instance.position[2])));
+
+  uint32_t bits = instance.rotation;
+  uint32_t largest = bits >> 30;
+  float q[4], sum = 0.0f;
+  for (uint32_t i = 0, shift = 0; i < 4; ++i) {
+    if (i == largest)
+      continue;
+    float unit = static_cast<float>((bits >> shift) & QUATERNION_STEPS) /
+                 QUATERNION_STEPS;
+    q[i] = unit * 2.0f * QUATERNION_RANGE - QUATERNION_RANGE;
+    sum += q[i] * q[i];
+    shift += 10;
+  }
+  q[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+  transform.setRotation(btQuaternion(q[0], q[1], q[2], q[3]));
+
+  color = glm::vec3(glm::unpackUnorm4x8(instance.color));
+}
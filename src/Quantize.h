@@ -0,0 +1,26 @@
+#ifndef _QUANTIZE_H_
+#define _QUANTIZE_H_
+
+#include "FramePacket.h"
+#include <LinearMath/btTransform.h>
+
+/*
+ * Encoding of QuantizedBoxInstances, 16 bytes instead of the 76 of a
+ * BoxInstance.
+ *
+ * Positions are half floats relative to a nearby origin (the camera), so
+ * their error grows with the view distance like the size of a pixel does:
+ * about 1/2048 of the distance. Rotations are quaternions with their largest
+ * component dropped, as it follows from the others; the remaining three lie
+ * in [-1/sqrt(2), 1/sqrt(2)] and are stored with 10 bits each.
+ */
+
+void quantizeBox(const btTransform& transform, const glm::vec3& color,
+                 const glm::vec3& origin, QuantizedBoxInstance& instance);
+
+// The inverse of quantizeBox(), as done by the box vertex shaders.
+void dequantizeBox(const QuantizedBoxInstance& instance,
+                   const glm::vec3& origin, btTransform& transform,
+                   glm::vec3& color);
+
+#endif // _QUANTIZE_H_
@@ -0,0 +1,126 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+void RenderQueue::submit(const DrawPacket& packet, float depth) {
+  _commands.push_back(Command{makeKey(packet, depth), _packets.size()});
+  _packets.push_back(packet);
+}
+
+/*
+ * Key layout, most significant bits first:
+ *   opaque:  0 | program (16) | vao (16) | depth (24) | unused (7)
+ *   blended: 1 | inverted depth (24) | program (16) | vao (16) | unused (7)
+ */
+uint64_t RenderQueue::makeKey(const DrawPacket& packet, float depth) {
+  uint64_t program = packet.shader->getProgram() & 0xFFFF;
+  uint64_t vao = packet.vao & 0xFFFF;
+  uint64_t z = static_cast<uint64_t>(
+      std::min(std::max(depth, 0.0f), 1.0f) * 0xFFFFFF);
+
+  if (packet.state.blend)
+    return 1ull << 63 | (0xFFFFFF - z) << 39 | program << 23 | vao << 7;
+  return program << 47 | vao << 31 | z << 7;
+}
+
+void RenderQueue::flush() {
+  std::stable_sort(
+      _commands.begin(), _commands.end(),
+      [](const Command& a, const Command& b) { return a.key < b.key; });
+
+  for (const auto& command : _commands) {
+    DrawPacket& packet = _packets[command.packet];
+
+    apply(packet.state);
+
+    GLint program = packet.shader->getProgram();
+    if (program != _program) {
+      packet.shader->use();
+      _program = program;
+      ++_stats.programBinds;
+    }
+
+    bindVertexArray(packet.vao);
+
+    switch (packet.kind) {
+    case DrawPacket::Arrays:
+      glDrawArraysInstanced(packet.mode, packet.first, packet.count,
+                            packet.instances);
+      break;
+    case DrawPacket::Elements:
+      glDrawElementsInstanced(packet.mode, packet.count, packet.indexType,
+                              nullptr, packet.instances);
+      break;
+    case DrawPacket::ArraysIndirect:
+      bindIndirectBuffer(packet.indirectBuffer);
+      glDrawArraysIndirect(packet.mode, (GLvoid*)packet.indirectOffset);
+      break;
+    case DrawPacket::ElementsIndirect:
+      bindIndirectBuffer(packet.indirectBuffer);
+      glDrawElementsIndirect(packet.mode, packet.indexType,
+                             (GLvoid*)packet.indirectOffset);
+      break;
+    }
+    ++_stats.draws;
+  }
+
+  // glClear honors the depth mask, so leave depth writes on
+  if (_depthWrite == 0) {
+    glDepthMask(GL_TRUE);
+    _depthWrite = 1;
+    ++_stats.stateChanges;
+  }
+
+  _packets.clear();
+  _commands.clear();
+}
+
+void RenderQueue::invalidate() {
+  _blend = _depthTest = _depthWrite = _cullFace = -1;
+  _polygonMode = _program = _vao = _indirectBuffer = -1;
+}
+
+void RenderQueue::apply(const RenderState& state) {
+  enable(GL_BLEND, state.blend, _blend);
+  enable(GL_DEPTH_TEST, state.depthTest, _depthTest);
+  enable(GL_CULL_FACE, state.cullFace, _cullFace);
+
+  if (_depthWrite != state.depthWrite) {
+    glDepthMask(state.depthWrite ? GL_TRUE : GL_FALSE);
+    _depthWrite = state.depthWrite;
+    ++_stats.stateChanges;
+  }
+
+  if (_polygonMode != static_cast<GLint>(state.polygonMode)) {
+    glPolygonMode(GL_FRONT_AND_BACK, state.polygonMode);
+    _polygonMode = state.polygonMode;
+    ++_stats.stateChanges;
+  }
+}
+
+void RenderQueue::enable(GLenum cap, bool enable, int& current) {
+  if (current == enable)
+    return;
+  if (enable)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  current = enable;
+  ++_stats.stateChanges;
+}
+
+void RenderQueue::bindVertexArray(GLuint vao) {
+  if (static_cast<GLint>(vao) == _vao)
+    return;
+  glBindVertexArray(vao);
+  _vao = vao;
+  ++_stats.vaoBinds;
+}
+
+void RenderQueue::bindIndirectBuffer(GLuint buffer) {
+  if (static_cast<GLint>(buffer) == _indirectBuffer)
+    return;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+  _indirectBuffer = buffer;
+  ++_stats.bufferBinds;
+}
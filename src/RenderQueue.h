@@ -0,0 +1,103 @@
+#ifndef _RENDERQUEUE_H_
+#define _RENDERQUEUE_H_
+
+#include "Shader.h"
+#include <cstdint>
+#include <vector>
+
+// Fixed-function state of a draw call.
+struct RenderState {
+  bool blend = false;
+  bool depthTest = true;
+  bool depthWrite = true;
+  bool cullFace = true;
+  GLenum polygonMode = GL_FILL;
+};
+
+/*
+ * A single draw call, with everything needed to issue it.
+ * Per-frame uniforms are expected to come from uniform blocks, and vertex
+ * array objects to be fully set up (e.g. instance offsets) on submission.
+ */
+struct DrawPacket {
+  enum Kind {
+    Arrays,           // glDrawArraysInstanced(mode, first, count, instances)
+    Elements,         // glDrawElementsInstanced(mode, count, indexType, ...)
+    ArraysIndirect,   // glDrawArraysIndirect from indirectBuffer
+    ElementsIndirect, // glDrawElementsIndirect from indirectBuffer
+  };
+
+  Shader* shader = nullptr;
+  GLuint vao = 0;
+  RenderState state;
+
+  Kind kind = Arrays;
+  GLenum mode = GL_TRIANGLES;
+  GLint first = 0;
+  GLsizei count = 0;
+  GLenum indexType = GL_UNSIGNED_SHORT;
+  GLsizei instances = 1;
+  GLuint indirectBuffer = 0;
+  GLintptr indirectOffset = 0;
+};
+
+/*
+ * Sorted render command queue.
+ *
+ * Passes submit draw packets in any order. flush() sorts them by a 64-bit
+ * key and issues them while tracking GL state, so only state that differs
+ * from the previous draw is changed. Opaque packets are sorted by program,
+ * VAO and then front to back; blended ones go last, back to front.
+ */
+class RenderQueue {
+public:
+  // Queues a packet; `depth` is its view distance, normalized to [0, 1].
+  void submit(const DrawPacket& packet, float depth = 0.0f);
+
+  // Sorts and issues all queued packets, then clears the queue. Depth writes
+  // are left on. The tracked state carries over to the next flush().
+  void flush();
+
+  // Binds `vao` outside of flush(), e.g. to set up its instance attributes,
+  // keeping track of the binding.
+  void bindVertexArray(GLuint vao);
+
+  // Forgets the tracked GL state, which must be done whenever GL state is
+  // changed outside of the queue.
+  void invalidate();
+
+  struct Stats {
+    unsigned draws = 0;
+    unsigned stateChanges = 0; // enable/disable, depth mask, polygon mode
+    unsigned programBinds = 0;
+    unsigned vaoBinds = 0;
+    unsigned bufferBinds = 0; // indirect buffers
+  };
+
+  // Counts of all flush() and bindVertexArray() calls since the last
+  // resetStats().
+  const Stats& getStats() const { return _stats; }
+  void resetStats() { _stats = Stats(); }
+
+private:
+  static uint64_t makeKey(const DrawPacket& packet, float depth);
+  void apply(const RenderState& state);
+  void enable(GLenum cap, bool enable, int& current);
+  void bindIndirectBuffer(GLuint buffer);
+
+private:
+  struct Command {
+    uint64_t key;
+    size_t packet;
+  };
+  std::vector<DrawPacket> _packets;
+  std::vector<Command> _commands;
+  Stats _stats;
+
+  // GL state cache; -1 means unknown
+  int _blend = -1, _depthTest = -1, _depthWrite = -1, _cullFace = -1;
+  GLint _polygonMode = -1;
+  GLint _program = -1, _vao = -1, _indirectBuffer = -1;
+};
+
+#endif // _RENDERQUEUE_H_
@@ -0,0 +1,124 @@
+#include "RenderTarget.h"
+
+#include <algorithm>
+
+RenderTarget::RenderTarget(int samples) {
+  GLint maxSamples = 0;
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  _samples = std::min(samples, static_cast<int>(maxSamples));
+
+  glGenVertexArrays(1, &_vao);
+  glGenFramebuffers(1, &_framebuffer);
+  glGenFramebuffers(1, &_resolveFBO);
+
+  // full screen triangle, sampling the resolved part of the texture
+  _upscaleShader.loadString(Shader::Vertex, R"(
+#version 330 core
+
+uniform vec2 uvScale;
+out vec2 uv;
+
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  uv = p * uvScale;
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)");
+  _upscaleShader.loadString(Shader::Fragment, R"(
+#version 330 core
+
+uniform sampler2D source;
+uniform vec2 uvMax; // keeps the filter off the unused texels
+in vec2 uv;
+out vec4 color;
+
+void main() {
+  color = texture(source, min(uv, uvMax));
+}
+)");
+  _sourceUniform = _upscaleShader.uniform<int>("source");
+  _uvScaleUniform = _upscaleShader.uniform<glm::vec2>("uvScale");
+  _uvMaxUniform = _upscaleShader.uniform<glm::vec2>("uvMax");
+}
+
+RenderTarget::~RenderTarget() {
+  release();
+  glDeleteFramebuffers(1, &_framebuffer);
+  glDeleteFramebuffers(1, &_resolveFBO);
+  glDeleteVertexArrays(1, &_vao);
+}
+
+void RenderTarget::reserve(int width, int height) {
+  if (width == _width && height == _height)
+    return;
+  release();
+  _width = width;
+  _height = height;
+
+  // sRGB color and 24-bit depth (see DepthPyramid)
+  glGenRenderbuffers(1, &_colorBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _colorBuffer);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples,
+                                   GL_SRGB8_ALPHA8, width, height);
+  glGenRenderbuffers(1, &_depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples,
+                                   GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, _colorBuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, _depthBuffer);
+
+  glGenTextures(1, &_resolveTexture);
+  glBindTexture(GL_TEXTURE_2D, _resolveTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, _resolveFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         _resolveTexture, 0);
+}
+
+void RenderTarget::release() {
+  glDeleteRenderbuffers(1, &_colorBuffer);
+  glDeleteRenderbuffers(1, &_depthBuffer);
+  glDeleteTextures(1, &_resolveTexture);
+  _colorBuffer = _depthBuffer = _resolveTexture = 0;
+  _width = _height = 0;
+}
+
+void RenderTarget::present(int width, int height, GLuint framebuffer,
+                           int dstWidth, int dstHeight) {
+  // resolve the samples; scaling can't be done in the same blit
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _resolveFBO);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  // and stretch them over the destination, which may be multisampled too
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, dstWidth, dstHeight);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  _upscaleShader.use();
+  _upscaleShader.set(_sourceUniform, 0);
+  _upscaleShader.set(_uvScaleUniform,
+                     glm::vec2(width, height) / glm::vec2(_width, _height));
+  _upscaleShader.set(_uvMaxUniform, (glm::vec2(width, height) - 0.5f) /
+                                        glm::vec2(_width, _height));
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, _resolveTexture);
+  glBindVertexArray(_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,52 @@
+#ifndef _RENDERTARGET_H_
+#define _RENDERTARGET_H_
+
+#include "Shader.h"
+
+/*
+ * Offscreen multisampled color and depth buffers for the scene, which may be
+ * drawn at a lower resolution than the window and stretched over it.
+ *
+ * The buffers are allocated once for the largest size in use, and smaller
+ * frames are drawn into their lower left corner, so changing the resolution
+ * doesn't reallocate anything.
+ */
+class RenderTarget {
+public:
+  explicit RenderTarget(int samples = 4);
+  ~RenderTarget();
+
+  RenderTarget(const RenderTarget&) = delete;
+  RenderTarget& operator=(const RenderTarget&) = delete;
+
+  // (Re)allocates the buffers if their size differs from the given one.
+  void reserve(int width, int height);
+
+  GLuint getFramebuffer() const { return _framebuffer; }
+
+  // Resolves the lower left `width` x `height` pixels and stretches them
+  // over `dstWidth` x `dstHeight` pixels of `framebuffer`, with bilinear
+  // filtering. The framebuffer is left bound, with depth testing, blending
+  // and face culling disabled and the polygon mode set to GL_FILL.
+  void present(int width, int height, GLuint framebuffer, int dstWidth,
+               int dstHeight);
+
+private:
+  void release();
+
+private:
+  int _samples;
+  int _width = 0, _height = 0;
+
+  GLuint _framebuffer = 0;
+  GLuint _colorBuffer = 0, _depthBuffer = 0; // multisampled renderbuffers
+  GLuint _resolveFBO = 0;
+  GLuint _resolveTexture = 0;
+
+  Shader _upscaleShader;
+  Shader::Uniform<int> _sourceUniform;
+  Shader::Uniform<glm::vec2> _uvScaleUniform, _uvMaxUniform;
+  GLuint _vao = 0;
+};
+
+#endif // _RENDERTARGET_H_
@@ -0,0 +1,104 @@
+#include "RenderThread.h"
+#include "Graphics.h"
+#include "Window.h"
+
+RenderThread::RenderThread(Window& window, Graphics& graphics,
+                           FramePacer::Mode pacing)
+    : _window(window), _graphics(graphics), _pacing(pacing),
+      _lastSubmit(clock::now()) {
+  _window.releaseContext();
+  _thread = std::thread(&RenderThread::run, this);
+}
+
+RenderThread::~RenderThread() {
+  _quit = true;
+  _thread.join();
+  _window.makeContextCurrent();
+}
+
+void RenderThread::submit() {
+  _mailbox.publish();
+
+  auto now = clock::now();
+  _simFrameTime = std::chrono::duration<double>(now - _lastSubmit).count();
+  _lastSubmit = now;
+}
+
+Graphics::RenderStats RenderThread::getRenderStats() const {
+  Graphics::RenderStats stats;
+  stats.visibleBoxes = _visibleBoxes;
+  stats.culledBoxes = _culledBoxes;
+  stats.occludedBoxes = _occludedBoxes;
+  for (int lod = 0; lod < FramePacket::LodCount; ++lod)
+    stats.lodBoxes[lod] = _lodBoxes[lod];
+  return stats;
+}
+
+RenderQueue::Stats RenderThread::getQueueStats() const {
+  RenderQueue::Stats stats;
+  stats.draws = _draws;
+  stats.stateChanges = _stateChanges;
+  stats.programBinds = _programBinds;
+  stats.vaoBinds = _vaoBinds;
+  stats.bufferBinds = _bufferBinds;
+  return stats;
+}
+
+StreamBuffer::Stats RenderThread::getStreamStats() const {
+  StreamBuffer::Stats stats;
+  stats.frames = _streamFrames;
+  stats.bytes = _streamBytes;
+  stats.stalls = _streamStalls;
+  stats.stallSeconds = _streamStallSeconds;
+  return stats;
+}
+
+void RenderThread::run() {
+  using namespace std::chrono_literals;
+
+  _window.makeContextCurrent();
+  _pacer.setMode(_window, _pacing);
+
+  auto lastFrame = clock::now();
+  while (!_quit) {
+    _pacer.beginFrame();
+    if (!_mailbox.update()) {
+      // nothing new to draw yet
+      std::this_thread::sleep_for(500us);
+      continue;
+    }
+
+    const FramePacket& frame = _mailbox.getReadBuffer();
+    _graphics.render(frame, _window.getFramebuffer());
+    float gpuTime = _graphics.getGpuProfiler().getFrameStats().last;
+    _pacer.endFrame(gpuTime * 1e-3);
+    _window.swapBuffers();
+    _pacer.framePresented(frame.inputTime);
+    _latency = _pacer.getStats().latency;
+    _jitter = _pacer.getStats().jitter;
+    _resolutionScale = _graphics.getResolutionScale();
+    const Graphics::RenderStats& stats = _graphics.getRenderStats();
+    _visibleBoxes = stats.visibleBoxes;
+    _culledBoxes = stats.culledBoxes;
+    _occludedBoxes = stats.occludedBoxes;
+    for (int lod = 0; lod < FramePacket::LodCount; ++lod)
+      _lodBoxes[lod] = stats.lodBoxes[lod];
+    const RenderQueue::Stats& queue = _graphics.getQueueStats();
+    _draws = queue.draws;
+    _stateChanges = queue.stateChanges;
+    _programBinds = queue.programBinds;
+    _vaoBinds = queue.vaoBinds;
+    _bufferBinds = queue.bufferBinds;
+    const StreamBuffer::Stats& stream = _graphics.getStreamStats();
+    _streamFrames = stream.frames;
+    _streamBytes = stream.bytes;
+    _streamStalls = stream.stalls;
+    _streamStallSeconds = stream.stallSeconds;
+
+    auto now = clock::now();
+    _renderFrameTime = std::chrono::duration<double>(now - lastFrame).count();
+    lastFrame = now;
+  }
+
+  _window.releaseContext();
+}
@@ -0,0 +1,90 @@
+#ifndef _RENDERTHREAD_H_
+#define _RENDERTHREAD_H_
+
+#include "FramePacer.h"
+#include "FramePacket.h"
+#include "Graphics.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class Window;
+
+/*
+ * Runs Graphics::render and buffer swaps on a dedicated thread that owns the
+ * window's GL context, so GPU and driver time don't delay the simulation.
+ *
+ * The simulation thread fills the packet returned by beginFrame() and hands
+ * it over with submit(); the render thread always draws the latest submitted
+ * packet. Neither thread ever blocks on the other. When to draw is up to a
+ * FramePacer.
+ */
+class RenderThread {
+public:
+  // Takes the GL context away from the calling thread.
+  RenderThread(Window& window, Graphics& graphics,
+               FramePacer::Mode pacing = FramePacer::VSync);
+  // Stops rendering and makes the GL context current on the calling thread.
+  ~RenderThread();
+
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+
+  // Simulation thread: packet to fill for the next frame.
+  FramePacket& beginFrame() { return _mailbox.getWriteBuffer(); }
+
+  // Simulation thread: publishes the packet returned by beginFrame().
+  void submit();
+
+  // Seconds between the last two submitted and rendered frames.
+  double getSimFrameTime() const { return _simFrameTime; }
+  double getRenderFrameTime() const { return _renderFrameTime; }
+
+  // Recent input to swap latency and standard deviation of the time between
+  // swaps, in seconds (see FramePacer).
+  double getLatency() const { return _latency; }
+  double getFrameJitter() const { return _jitter; }
+
+  // Box counts of the last rendered frame (see Graphics::getRenderStats).
+  Graphics::RenderStats getRenderStats() const;
+
+  // Draw, state change and bind counts of the last rendered frame.
+  RenderQueue::Stats getQueueStats() const;
+
+  // Statistics of the instance stream, since rendering started.
+  StreamBuffer::Stats getStreamStats() const;
+
+  // Dynamic resolution scale of the last rendered frame.
+  float getResolutionScale() const { return _resolutionScale; }
+
+private:
+  void run();
+
+private:
+  using clock = std::chrono::high_resolution_clock;
+
+  Window& _window;
+  Graphics& _graphics;
+  TripleBuffer<FramePacket> _mailbox;
+  FramePacer::Mode _pacing;
+  FramePacer _pacer; // used by the render thread only
+
+  clock::time_point _lastSubmit;
+  std::atomic<double> _simFrameTime{0.0};
+  std::atomic<double> _renderFrameTime{0.0};
+  std::atomic<double> _latency{0.0};
+  std::atomic<double> _jitter{0.0};
+  std::atomic<float> _resolutionScale{1.0f};
+  std::atomic<size_t> _visibleBoxes{0}, _culledBoxes{0}, _occludedBoxes{0};
+  std::atomic<size_t> _lodBoxes[FramePacket::LodCount] = {};
+  std::atomic<unsigned> _draws{0}, _stateChanges{0}, _programBinds{0};
+  std::atomic<unsigned> _vaoBinds{0}, _bufferBinds{0};
+  std::atomic<uint64_t> _streamFrames{0}, _streamBytes{0}, _streamStalls{0};
+  std::atomic<double> _streamStallSeconds{0.0};
+
+  std::atomic<bool> _quit{false};
+  std::thread _thread;
+};
+
+#endif // _RENDERTHREAD_H_
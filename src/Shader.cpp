@@ -11,21 +11,23 @@ constexpr const char* SHADER_NAME[] = {
     "Geometry",
     "Tessellation Control",
     "Tessellation Evaluation",
+    "Compute",
 };
 
 constexpr const char* SHADER_EXT[] = {
-    ".vert", ".frag", ".geom", ".tesc", ".tese",
+    ".vert", ".frag", ".geom", ".tesc", ".tese", ".comp",
 };
 
 constexpr GLenum SHADER_GLENUM[] = {
-    GL_VERTEX_SHADER,         // vs
-    GL_FRAGMENT_SHADER,       // fs
-    GL_GEOMETRY_SHADER,       // gs
-    GL_TESS_CONTROL_SHADER,   // tc
-    GL_TESS_EVALUATION_SHADER // te
+    GL_VERTEX_SHADER,          // vs
+    GL_FRAGMENT_SHADER,        // fs
+    GL_GEOMETRY_SHADER,        // gs
+    GL_TESS_CONTROL_SHADER,    // tc
+    GL_TESS_EVALUATION_SHADER, // te
+    GL_COMPUTE_SHADER          // cs
 };
 
-Shader::Shader() : _program(0), _shaders{0}, _dirty(0) {
+Shader::Shader() : _program(0), _shaders{0}, _dirty(0), _reflected(false) {
   // empty
 }
 
@@ -100,7 +102,11 @@ bool Shader::link() {
   }
 
   glLinkProgram(_program);
-  return checkProgram();
+  if (!checkProgram())
+    return false;
+
+  reflect();
+  return true;
 }
 
 bool Shader::use() {
@@ -117,31 +123,170 @@ inline auto getLogger() {
   return s_logger;
 }
 
-GLint Shader::getLocation(const char* uniform) {
-  GLint location = glGetUniformLocation(_program, uniform);
-  if (location < 0)
-    getLogger()->error() << "No such Uniform: " << uniform;
-  return location;
+int Shader::findUniform(const char* name) {
+  auto it = _uniformIndex.find(name);
+  if (it != _uniformIndex.end())
+    return it->second;
+
+  int index = _uniforms.size();
+  _uniforms.emplace_back();
+  _uniforms.back().name = name;
+  _uniformIndex.emplace(name, index);
+  if (_reflected)
+    resolve(_uniforms.back());
+  return index;
+}
+
+void Shader::resolve(UniformSlot& slot) {
+  auto it = _activeUniforms.find(slot.name);
+  slot.location = it != _activeUniforms.end() ? it->second.location : -1;
+  slot.type = it != _activeUniforms.end() ? it->second.type : GL_NONE;
+  slot.shadowed = false;
+  if (slot.location < 0)
+    getLogger()->error() << "No such Uniform: " << slot.name;
+}
+
+void Shader::bindUniformBlock(const char* name, GLuint binding) {
+  _blockBindings.emplace_back(name, binding);
+  if (_reflected) {
+    GLuint index = glGetUniformBlockIndex(_program, name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(_program, index, binding);
+  }
+}
+
+// Caches the locations and types of all active uniforms, re-resolves the
+// handles and maps uniform blocks to their binding points.
+void Shader::reflect() {
+  _activeUniforms.clear();
+
+  GLint numUniforms;
+  glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &numUniforms);
+
+  GLchar buffer[256];
+  for (GLint i = 0; i < numUniforms; ++i) {
+    GLsizei len;
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(_program, i, sizeof(buffer), &len, &size, &type, buffer);
+    GLint location = glGetUniformLocation(_program, buffer);
+    if (location < 0)
+      continue; // member of a uniform block
+
+    // arrays are reported as "name[0]"; make them reachable by plain name
+    std::string name(buffer, len);
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+      name.resize(name.size() - 3);
+    _activeUniforms.emplace(std::move(name), ActiveUniform{location, type});
+  }
+
+  for (auto& slot : _uniforms)
+    resolve(slot);
+
+  for (auto& block : _blockBindings) {
+    GLuint index = glGetUniformBlockIndex(_program, block.first.c_str());
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(_program, index, block.second);
+  }
+  _reflected = true;
+}
+
+void Shader::setUniform(const char* name, int v) {
+  set(uniform<int>(name), v);
 }
 
 void Shader::setUniform(const char* name, float v) {
-  glUniform1f(getLocation(name), v);
+  set(uniform<float>(name), v);
 }
 
 void Shader::setUniform(const char* name, const glm::vec2& v) {
-  glUniform2fv(getLocation(name), 1, glm::value_ptr(v));
+  set(uniform<glm::vec2>(name), v);
 }
 
 void Shader::setUniform(const char* name, const glm::vec3& v) {
-  glUniform3fv(getLocation(name), 1, glm::value_ptr(v));
+  set(uniform<glm::vec3>(name), v);
 }
 
 void Shader::setUniform(const char* name, const glm::vec4& v) {
-  glUniform4fv(getLocation(name), 1, glm::value_ptr(v));
+  set(uniform<glm::vec4>(name), v);
 }
 
 void Shader::setUniform(const char* name, const glm::mat4& v) {
-  glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, glm::value_ptr(v));
+  set(uniform<glm::mat4>(name), v);
+}
+
+void Shader::setUniform(const char* name, const glm::vec4* v, int count) {
+  set(uniform<glm::vec4>(name), v, count);
+}
+
+void Shader::set(Uniform<glm::vec4> handle, const glm::vec4* v, int count) {
+  if (handle.index < 0)
+    return;
+  const UniformSlot& slot = _uniforms[handle.index];
+  assert((slot.location < 0 || isCompatible(slot.type, GL_FLOAT_VEC4)) &&
+         "uniform set with another type than declared");
+  glUniform4fv(slot.location, count, glm::value_ptr(*v));
+}
+
+void Shader::upload(GLint location, int v) {
+  glUniform1i(location, v);
+}
+
+void Shader::upload(GLint location, float v) {
+  glUniform1f(location, v);
+}
+
+void Shader::upload(GLint location, const glm::vec2& v) {
+  glUniform2fv(location, 1, glm::value_ptr(v));
+}
+
+void Shader::upload(GLint location, const glm::vec3& v) {
+  glUniform3fv(location, 1, glm::value_ptr(v));
+}
+
+void Shader::upload(GLint location, const glm::vec4& v) {
+  glUniform4fv(location, 1, glm::value_ptr(v));
+}
+
+void Shader::upload(GLint location, const glm::mat4& v) {
+  glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(v));
+}
+
+// glUniform1i also sets booleans, samplers and images; other types have to
+// match exactly
+bool Shader::isCompatible(GLenum declared, GLenum type) {
+  if (declared == type)
+    return true;
+  if (type != GL_INT)
+    return false;
+  switch (declared) {
+  case GL_FLOAT:
+  case GL_FLOAT_VEC2:
+  case GL_FLOAT_VEC3:
+  case GL_FLOAT_VEC4:
+  case GL_INT_VEC2:
+  case GL_INT_VEC3:
+  case GL_INT_VEC4:
+  case GL_UNSIGNED_INT:
+  case GL_UNSIGNED_INT_VEC2:
+  case GL_UNSIGNED_INT_VEC3:
+  case GL_UNSIGNED_INT_VEC4:
+  case GL_BOOL_VEC2:
+  case GL_BOOL_VEC3:
+  case GL_BOOL_VEC4:
+  case GL_FLOAT_MAT2:
+  case GL_FLOAT_MAT3:
+  case GL_FLOAT_MAT4:
+  case GL_FLOAT_MAT2x3:
+  case GL_FLOAT_MAT2x4:
+  case GL_FLOAT_MAT3x2:
+  case GL_FLOAT_MAT3x4:
+  case GL_FLOAT_MAT4x2:
+  case GL_FLOAT_MAT4x3:
+    return false;
+  default: // GL_BOOL, samplers and images
+    return true;
+  }
 }
 
 void Shader::clear() {
@@ -3,7 +3,12 @@
 
 #include "glad.h"
 #include <glm/glm.hpp>
+#include <cassert>
+#include <cstring>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 /*
  * Abstraction for GLSL programs.
@@ -20,6 +25,7 @@ public:
     Geometry,
     TessControl,
     TessEvaluation,
+    Compute, // GL 4.3+, must be the only stage of its program
     Count
   };
 
@@ -30,7 +36,7 @@ public:
   /*
    * Given a file name prefix (without .extension), this method loads the set
    * of shader files that match fileNamePrefix concatenated with one of the
-   * canonical filename extensions: .vert, .frag, .geom, .tesc or .tese.
+   * canonical filename extensions: .vert, .frag, .geom, .tesc, .tese or .comp.
    * Returns the number of files loaded.
    */
   int load(const std::string& filePrefix);
@@ -42,12 +48,61 @@ public:
   // Calls link() and activates the shader program.
   bool use();
 
-  // Set uniform values by name. The shader program must be in use.
+  // Program object (zero until a shader has been loaded).
+  GLuint getProgram() const { return _program; }
+
+  /*
+   * Handle to a uniform variable. Its location is resolved through program
+   * reflection after each link, and the last uploaded value is shadowed so
+   * that setting the same value again skips the glUniform* call.
+   */
+  template <typename T>
+  struct Uniform {
+    int index = -1; // into the shader's uniform table
+  };
+
+  // Returns a handle to the named uniform. The program need not be linked.
+  template <typename T>
+  Uniform<T> uniform(const char* name) {
+    return Uniform<T>{findUniform(name)};
+  }
+
+  // Sets a uniform through its handle. The shader program must be in use.
+  // Default-constructed handles are ignored. In debug builds, T must match
+  // the type the program declares.
+  template <typename T>
+  void set(Uniform<T> handle, const T& v) {
+    static_assert(sizeof(T) <= sizeof(UniformSlot::value), "too large");
+    if (handle.index < 0)
+      return;
+    UniformSlot& slot = _uniforms[handle.index];
+    assert((slot.location < 0 || isCompatible(slot.type, glType(v))) &&
+           "uniform set with another type than declared");
+    if (slot.location < 0 ||
+        (slot.shadowed && std::memcmp(slot.value, &v, sizeof(T)) == 0))
+      return;
+    std::memcpy(slot.value, &v, sizeof(T));
+    slot.shadowed = true;
+    upload(slot.location, v);
+  }
+
+  // Sets `count` elements of a uniform array through its handle. Arrays are
+  // not shadowed.
+  void set(Uniform<glm::vec4> handle, const glm::vec4* v, int count);
+
+  // Set uniform values by name (slow path: looks the uniform up by name).
+  // The shader program must be in use.
+  void setUniform(const char* name, int v);
   void setUniform(const char* name, float v);
   void setUniform(const char* name, const glm::vec2& v);
   void setUniform(const char* name, const glm::vec3& v);
   void setUniform(const char* name, const glm::vec4& v);
   void setUniform(const char* name, const glm::mat4& v);
+  void setUniform(const char* name, const glm::vec4* v, int count);
+
+  // Maps the named uniform block to a binding point. Applied on every link;
+  // programs that don't declare the block ignore it.
+  void bindUniformBlock(const char* name, GLuint binding);
 
   // Prints to stdout a list with all active uniform variables in the program
   void printActiveUniforms() const;
@@ -56,14 +111,51 @@ public:
   void clear();
 
 private:
-  GLint getLocation(const char* uniform);
+  struct UniformSlot {
+    std::string name;
+    GLint location = -1;
+    GLenum type = GL_NONE; // as declared in the program
+    bool shadowed = false; // whether value holds the last uploaded value
+    unsigned char value[sizeof(glm::mat4)];
+  };
+
+  int findUniform(const char* name);
+  void resolve(UniformSlot& slot);
+  void reflect();
   bool checkShader(int i);
   bool checkProgram();
 
+  static void upload(GLint location, int v);
+  static void upload(GLint location, float v);
+  static void upload(GLint location, const glm::vec2& v);
+  static void upload(GLint location, const glm::vec3& v);
+  static void upload(GLint location, const glm::vec4& v);
+  static void upload(GLint location, const glm::mat4& v);
+
+  // GL type of uniforms set with a T, and whether those setters can set a
+  // uniform of type `declared`
+  static GLenum glType(int) { return GL_INT; }
+  static GLenum glType(float) { return GL_FLOAT; }
+  static GLenum glType(const glm::vec2&) { return GL_FLOAT_VEC2; }
+  static GLenum glType(const glm::vec3&) { return GL_FLOAT_VEC3; }
+  static GLenum glType(const glm::vec4&) { return GL_FLOAT_VEC4; }
+  static GLenum glType(const glm::mat4&) { return GL_FLOAT_MAT4; }
+  static bool isCompatible(GLenum declared, GLenum type);
+
 private:
   GLuint _program;        // program object
   GLuint _shaders[Count]; // shader objects; TODO remove these in production
   int _dirty;             // non-zero when a shader contains modifications
+  bool _reflected;        // _activeUniforms, _uniforms match the program
+
+  struct ActiveUniform {
+    GLint location;
+    GLenum type;
+  };
+  std::unordered_map<std::string, ActiveUniform> _activeUniforms;
+  std::unordered_map<std::string, int> _uniformIndex; // into _uniforms
+  std::vector<UniformSlot> _uniforms;
+  std::vector<std::pair<std::string, GLuint>> _blockBindings;
 };
 
 #endif // _SHADER_H_
@@ -0,0 +1,105 @@
+#ifndef _SLOTMAP_H_
+#define _SLOTMAP_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Stable handles to elements kept densely packed, in arrays owned by the
+ * user of the map (one per component).
+ *
+ * A handle names a slot, which holds the element's current index into the
+ * dense arrays, and the slot's generation, which changes whenever the slot
+ * is freed, so handles to removed elements never reach the element that
+ * reuses their slot. Removing an element moves the last one into its
+ * place, and the arrays have to follow.
+ *
+ * Freed slots are reused oldest first, so a generation only comes around
+ * again after many removals of the same slot.
+ */
+class SlotMap {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle INVALID = 0; // never returned by insert()
+
+  // Adds an element at index size() - 1.
+  Handle insert() {
+    uint32_t slot;
+    if (_freeCount > 0) {
+      slot = _freeHead;
+      _freeHead = _slots[slot].index;
+      --_freeCount;
+    } else {
+      assert(_slots.size() <= INDEX_MASK && "too many elements");
+      slot = _slots.size();
+      _slots.push_back(Slot{0, 1});
+    }
+    _slots[slot].index = _handles.size();
+    Handle handle = _slots[slot].generation << INDEX_BITS | slot;
+    _handles.push_back(handle);
+    return handle;
+  }
+
+  // Index of the element, or -1 if it was removed.
+  int indexOf(Handle handle) const {
+    uint32_t slot = handle & INDEX_MASK;
+    if (slot >= _slots.size() ||
+        _slots[slot].generation != handle >> INDEX_BITS)
+      return -1;
+    return _slots[slot].index;
+  }
+  bool contains(Handle handle) const { return indexOf(handle) >= 0; }
+
+  /*
+   * Removes the element of `handle`, which must be valid, and returns its
+   * index. Unless it was the last, the last element now takes that index:
+   * the arrays have to move it there, and then drop their last element.
+   */
+  int remove(Handle handle) {
+    int index = indexOf(handle);
+    assert(index >= 0 && "stale handle");
+    Handle last = _handles.back();
+    _slots[last & INDEX_MASK].index = index;
+    _handles[index] = last;
+    _handles.pop_back();
+
+    // retire the slot at the end of the free list
+    uint32_t slot = handle & INDEX_MASK;
+    Slot& removed = _slots[slot];
+    removed.generation = (removed.generation + 1) & GENERATION_MASK;
+    if (removed.generation == 0) // keeps INVALID out of reach
+      removed.generation = 1;
+    if (_freeCount > 0)
+      _slots[_freeTail].index = slot;
+    else
+      _freeHead = slot;
+    _freeTail = slot;
+    ++_freeCount;
+    return index;
+  }
+
+  size_t size() const { return _handles.size(); }
+
+  // Handles by element index.
+  const std::vector<Handle>& getHandles() const { return _handles; }
+
+private:
+  static constexpr int INDEX_BITS = 20; // a million elements
+  static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+  static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+  struct Slot {
+    uint32_t index; // of the element, or of the next free slot
+    uint32_t generation;
+  };
+
+private:
+  std::vector<Slot> _slots;
+  std::vector<Handle> _handles;
+  uint32_t _freeHead = 0, _freeTail = 0;
+  size_t _freeCount = 0;
+};
+
+#endif // _SLOTMAP_H_
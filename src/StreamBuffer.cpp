@@ -0,0 +1,148 @@
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+StreamBuffer::StreamBuffer(GLenum target, int framesInFlight)
+    : _target(target), _numRegions(framesInFlight),
+      _persistent(GLAD_GL_VERSION_4_4 != 0), _fences(framesInFlight, nullptr) {
+  // without persistent mapping the driver handles buffering for us
+  if (!_persistent)
+    _numRegions = 1;
+
+  // so that any region can be bound as a uniform or storage buffer range
+  GLint alignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  _alignment = std::max<size_t>(_alignment, alignment);
+  if (GLAD_GL_VERSION_4_3) {
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    _alignment = std::max<size_t>(_alignment, alignment);
+  }
+}
+
+StreamBuffer::~StreamBuffer() {
+  release();
+}
+
+void* StreamBuffer::map(size_t size, size_t alignment) {
+  assert((alignment & (alignment - 1)) == 0);
+  _alignment = std::max(_alignment, alignment);
+  size_t offset = (_head + alignment - 1) / alignment * alignment;
+
+  if (offset + size > _stats.regionSize) {
+    // grow with some slack; data mapped earlier this frame lives on in the
+    // old buffer object, which the GL keeps alive while draws still use it
+    allocate(std::max(size + size / 2, _stats.regionSize * 2));
+    offset = 0;
+  } else if (_stats.regionSize % _alignment != 0) {
+    // a larger alignment than before, which the later regions would miss
+    allocate(_stats.regionSize);
+    offset = 0;
+  }
+
+  if (_head == 0)
+    waitRegion(_region);
+
+  _mapOffset = offset;
+  _mapSize = size;
+  _mapAlignment = alignment;
+  _head = offset + size;
+  _stats.bytes += size;
+
+  if (_persistent)
+    return _mapped + _region * _stats.regionSize + offset;
+
+  glBindBuffer(_target, _buffer);
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+  if (offset == 0) {
+    // first write this frame: orphan the storage the GPU may still be using
+    glBufferData(_target, _stats.regionSize, nullptr, GL_STREAM_DRAW);
+    access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+  }
+  return glMapBufferRange(_target, offset, size, access);
+}
+
+GLintptr StreamBuffer::unmap() {
+  if (!_persistent) {
+    glBindBuffer(_target, _buffer);
+    glUnmapBuffer(_target);
+  }
+  GLintptr offset = _region * _stats.regionSize + _mapOffset;
+  assert(offset % _mapAlignment == 0);
+  return offset;
+}
+
+void StreamBuffer::endFrame() {
+  if (_persistent && _head > 0) {
+    assert(!_fences[_region]);
+    _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  _region = (_region + 1) % _numRegions;
+  _head = 0;
+  ++_stats.frames;
+}
+
+void StreamBuffer::allocate(size_t regionSize) {
+  release();
+
+  // powers of two, so a multiple of the largest is one of all of them
+  regionSize = (regionSize + _alignment - 1) / _alignment * _alignment;
+  _stats.regionSize = regionSize;
+  GLsizeiptr totalSize = regionSize * _numRegions;
+
+  glGenBuffers(1, &_buffer);
+  glBindBuffer(_target, _buffer);
+  if (_persistent) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(_target, totalSize, nullptr, flags);
+    _mapped =
+        static_cast<uint8_t*>(glMapBufferRange(_target, 0, totalSize, flags));
+  } else {
+    glBufferData(_target, totalSize, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+void StreamBuffer::release() {
+  for (auto& fence : _fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  if (_buffer) {
+    if (_mapped) {
+      glBindBuffer(_target, _buffer);
+      glUnmapBuffer(_target);
+      _mapped = nullptr;
+    }
+    // the GL keeps the storage alive until pending draws are done with it
+    glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+  }
+  _region = 0;
+  _head = 0;
+}
+
+void StreamBuffer::waitRegion(int region) {
+  GLsync& fence = _fences[region];
+  if (!fence)
+    return;
+
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    // the CPU is a full ring ahead of the GPU
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+    do {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    std::chrono::duration<double> waited = clock::now() - start;
+    ++_stats.stalls;
+    _stats.stallSeconds += waited.count();
+  }
+
+  glDeleteSync(fence);
+  fence = nullptr;
+}
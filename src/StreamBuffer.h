@@ -0,0 +1,77 @@
+#ifndef _STREAMBUFFER_H_
+#define _STREAMBUFFER_H_
+
+#include "glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Ring buffer for streaming per-frame data (e.g. instance attributes) to the
+ * GPU without stalling the driver.
+ *
+ * The buffer is split into one region per frame in flight. On GL 4.4+
+ * (GL_ARB_buffer_storage) it is persistently and coherently mapped, and each
+ * region is guarded by a fence so the CPU only waits when it gets more than
+ * `framesInFlight` frames ahead of the GPU. Older contexts fall back to
+ * orphaning the buffer once per frame.
+ */
+class StreamBuffer {
+public:
+  StreamBuffer(GLenum target, int framesInFlight = 3);
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // Reserves `size` bytes in the current frame's region and returns a pointer
+  // to write them, at an offset within getBuffer() that is a multiple of
+  // `alignment` (a power of two). Every map() must be followed by unmap()
+  // before drawing.
+  void* map(size_t size, size_t alignment = 16);
+
+  // Finishes the last map(). Returns its byte offset within getBuffer().
+  GLintptr unmap();
+
+  // Fences the current region and moves on to the next one. Must be called
+  // once per frame, after the draw calls that read from this frame's data.
+  void endFrame();
+
+  // Buffer object holding the data. May change when the buffer has to grow,
+  // so it must be queried after each map(), and draws sourcing earlier maps
+  // must be issued before the next map().
+  GLuint getBuffer() const { return _buffer; }
+
+  struct Stats {
+    uint64_t frames = 0;       // frames streamed
+    uint64_t bytes = 0;        // total bytes mapped
+    uint64_t stalls = 0;       // times the CPU had to wait for the GPU
+    double stallSeconds = 0.0; // total time spent waiting
+    size_t regionSize = 0;     // bytes available per frame
+  };
+  const Stats& getStats() const { return _stats; }
+
+private:
+  void allocate(size_t regionSize);
+  void release();
+  void waitRegion(int region);
+
+private:
+  GLenum _target;
+  int _numRegions;
+  bool _persistent;            // true when using GL_ARB_buffer_storage
+  GLuint _buffer = 0;
+  uint8_t* _mapped = nullptr;  // persistent mapping of the whole buffer
+  std::vector<GLsync> _fences; // one per region
+  int _region = 0;             // region being written this frame
+  size_t _head = 0;            // bytes used in the current region
+  size_t _mapOffset = 0;       // region-relative offset of the last map()
+  size_t _mapSize = 0;
+  size_t _mapAlignment = 1;
+  // every region starts at a multiple of this: the largest alignment asked
+  // for, and at least the offset alignment of uniform and storage buffers
+  size_t _alignment = 1;
+  Stats _stats;
+};
+
+#endif // _STREAMBUFFER_H_
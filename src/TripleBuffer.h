@@ -0,0 +1,46 @@
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single producer, single consumer mailbox.
+ *
+ * The producer fills its own buffer and publishes it, the consumer picks up
+ * the most recently published one; neither side ever waits for the other.
+ * Buffers are recycled, so their allocations are reused from frame to frame.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  // Producer: buffer to fill. Its previous contents are stale.
+  T& getWriteBuffer() { return _buffers[_write]; }
+
+  // Producer: publishes the write buffer, replacing any unread one.
+  void publish() {
+    _write = _middle.exchange(static_cast<uint8_t>(_write | FRESH)) & INDEX;
+  }
+
+  // Consumer: switches to the latest published buffer, if there is a new
+  // one. Returns whether it did.
+  bool update() {
+    if (!(_middle.load() & FRESH))
+      return false;
+    _read = _middle.exchange(_read) & INDEX;
+    return true;
+  }
+
+  // Consumer: buffer picked up by the last successful update().
+  const T& getReadBuffer() const { return _buffers[_read]; }
+
+private:
+  static constexpr uint8_t INDEX = 0x3;
+  static constexpr uint8_t FRESH = 0x4; // middle holds an unread buffer
+
+  T _buffers[3];
+  uint8_t _write = 0, _read = 1;
+  std::atomic<uint8_t> _middle{2};
+};
+
+#endif // _TRIPLEBUFFER_H_
@@ -0,0 +1,39 @@
+#ifndef _UNIFORMBUFFER_H_
+#define _UNIFORMBUFFER_H_
+
+#include "glad.h"
+
+/*
+ * Uniform buffer object holding a single std140 struct T, bound to a fixed
+ * binding point so that any program declaring the matching block (and
+ * mapping it with Shader::bindUniformBlock) reads the same data.
+ */
+template <typename T>
+class UniformBuffer {
+public:
+  explicit UniformBuffer(GLuint binding) : _binding(binding) {
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, _binding, _buffer);
+  }
+
+  ~UniformBuffer() { glDeleteBuffers(1, &_buffer); }
+
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+  // Replaces the contents, orphaning storage still in use by the GPU.
+  void update(const T& data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &data, GL_DYNAMIC_DRAW);
+  }
+
+  GLuint getBinding() const { return _binding; }
+
+private:
+  GLuint _binding;
+  GLuint _buffer = 0;
+};
+
+#endif // _UNIFORMBUFFER_H_
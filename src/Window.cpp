@@ -1,6 +1,17 @@
 #include "Window.h"
 #include "glad.h"
 
+#include <algorithm>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
 Window::Window() {
   // create a multithreaded console logger with color support
   _logger = spdlog::stdout_logger_mt("window", true /*use color*/);
@@ -25,12 +36,13 @@ Window::Window() {
   SDL_GL_SetAttribute(SDL_GL_BUFFER_SIZE, 32);
   SDL_GL_SetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, 1);
 
-  // request anti-aliasing
-  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+  // no depth buffer either, the scene target has one
+  SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 0);
 
-  // enable v-sync
-  SDL_GL_SetSwapInterval(1);
+  // no anti-aliasing, as the scene is drawn into a multisampled target of
+  // its own and only stretched over the window (see RenderTarget)
+  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 0);
+  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 0);
 
   // create window
   _window =
@@ -49,6 +61,80 @@ Window::Window() {
   // load OpenGL functions
   gladLoadGL();
 
+  logInfo();
+}
+
+Window::Window(int width, int height)
+    : _width(width), _height(height), _headless(true) {
+  _logger = spdlog::stdout_logger_mt("window", true /*use color*/);
+  _logger->info() << "Starting headless at " << width << "x" << height;
+
+#ifdef HAVE_EGL
+  // prefer Mesa's surfaceless platform, which needs no display server
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (getPlatformDisplay) {
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                 EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    die("eglInitialize");
+  _eglDisplay = display;
+
+  // use OpenGL 3.3+ core profile, rendering into our own framebuffer
+  if (!eglBindAPI(EGL_OPENGL_API))
+    die("eglBindAPI");
+  const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                  EGL_NONE};
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) ||
+      numConfigs < 1)
+    die("eglChooseConfig");
+  const EGLint contextAttribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION,       3,
+      EGL_CONTEXT_MINOR_VERSION,       3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  _eglContext =
+      eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+  if (_eglContext == EGL_NO_CONTEXT)
+    die("eglCreateContext");
+  makeContextCurrent();
+
+  // load OpenGL functions
+  gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+
+  // sRGB color like the window
+  glGenRenderbuffers(1, &_renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, _renderbuffer);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    die("glCheckFramebufferStatus");
+
+  logInfo();
+#else
+  die("Headless mode");
+#endif
+}
+
+void Window::logInfo() {
+  if (_headless) {
+    _logger->info() << "OpenGL Info:\n"
+                    << "OpenGL " << glGetString(GL_VERSION) << '\n'
+                    << "Renderer " << glGetString(GL_RENDERER) << '\n';
+    return;
+  }
+
   // print OpenGL context info
   int buf_sz, buf_aa, buf_srgb;
   SDL_GL_GetAttribute(SDL_GL_BUFFER_SIZE, &buf_sz);
@@ -61,12 +147,26 @@ Window::Window() {
 }
 
 Window::~Window() {
+  if (_headless) {
+#ifdef HAVE_EGL
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteRenderbuffers(1, &_renderbuffer);
+    eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(_eglDisplay, _eglContext);
+    eglTerminate(_eglDisplay);
+#endif
+    return;
+  }
+
   SDL_GL_DeleteContext(_context);
   SDL_DestroyWindow(_window);
   SDL_Quit();
 }
 
 bool Window::handleEvents(InputHandler& handler) {
+  if (_headless)
+    return false;
+
   SDL_Event ev;
   while (SDL_PollEvent(&ev)) {
     switch (ev.type) {
@@ -87,9 +187,30 @@ bool Window::handleEvents(InputHandler& handler) {
       case SDLK_F2:
         handler.resetPosition();
         break;
+      case SDLK_F3:
+        handler.toggleGpuCulling();
+        break;
+      case SDLK_F4:
+        handler.toggleOcclusionCulling();
+        break;
+      case SDLK_F5:
+        handler.toggleProfilerOverlay();
+        break;
+      case SDLK_F6:
+        handler.togglePipelineStatistics();
+        break;
+      case SDLK_F7:
+        handler.toggleDynamicResolution();
+        break;
+      case SDLK_F8:
+        handler.nextInstanceFormat();
+        break;
       case SDLK_SPACE:
         handler.shoot();
         break;
+      case SDLK_BACKSPACE:
+        handler.despawn();
+        break;
       }
       break;
 
@@ -128,11 +249,78 @@ bool Window::handleEvents(InputHandler& handler) {
 }
 
 void Window::swapBuffers() {
-  SDL_GL_SwapWindow(_window);
+  if (_headless)
+    glFinish();
+  else
+    SDL_GL_SwapWindow(_window);
+}
+
+bool Window::setSwapInterval(int interval) {
+  if (_headless)
+    return true;
+  return SDL_GL_SetSwapInterval(interval) == 0;
+}
+
+int Window::getRefreshRate() {
+  SDL_DisplayMode mode;
+  if (_headless || SDL_GetWindowDisplayMode(_window, &mode) < 0)
+    return 0;
+  return mode.refresh_rate;
+}
+
+void Window::readPixels(std::vector<unsigned char>& pixels) {
+  size_t stride = _width * 4;
+  pixels.resize(stride * _height);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+  glReadBuffer(_headless ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels.data());
+
+  // OpenGL returns the bottom row first
+  for (int y = 0; y < _height / 2; ++y) {
+    std::swap_ranges(pixels.begin() + y * stride,
+                     pixels.begin() + (y + 1) * stride,
+                     pixels.begin() + (_height - 1 - y) * stride);
+  }
+}
+
+void Window::makeContextCurrent() {
+#ifdef HAVE_EGL
+  if (_headless) {
+    if (!eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        _eglContext))
+      die("eglMakeCurrent");
+    return;
+  }
+#endif
+  if (SDL_GL_MakeCurrent(_window, _context) < 0)
+    die("SDL_GL_MakeCurrent");
+}
+
+void Window::releaseContext() {
+#ifdef HAVE_EGL
+  if (_headless) {
+    eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    return;
+  }
+#endif
+  SDL_GL_MakeCurrent(_window, nullptr);
 }
 
 void Window::die(const char* what) {
-  _logger->critical() << what << " failed: " << SDL_GetError();
+  if (!_headless) {
+    _logger->critical() << what << " failed: " << SDL_GetError();
+  } else {
+#ifdef HAVE_EGL
+    _logger->critical() << what << " failed: EGL error 0x" << std::hex
+                        << eglGetError();
+#else
+    _logger->critical() << what << " failed: built without EGL";
+#endif
+  }
   _logger->flush();
   std::exit(-1);
 }
@@ -3,6 +3,7 @@
 
 #include <SDL2/SDL.h>
 #include <spdlog/spdlog.h>
+#include <vector>
 
 // Window sends all input events to this interface.
 class InputHandler {
@@ -13,16 +14,28 @@ public:
 
   // Actions
   virtual void shoot() = 0;
+  virtual void despawn() = 0;
   virtual void resetPosition() = 0;
   virtual void toggleWireframe() = 0;
+  virtual void toggleGpuCulling() = 0;
+  virtual void toggleOcclusionCulling() = 0;
+  virtual void toggleProfilerOverlay() = 0;
+  virtual void togglePipelineStatistics() = 0;
+  virtual void toggleDynamicResolution() = 0;
+  virtual void nextInstanceFormat() = 0;
 };
 
 /*
  * A GUI window with an OpenGL canvas.
+ *
+ * In headless mode there is no window: the canvas is an offscreen
+ * framebuffer of fixed size, on a surfaceless EGL context that works without
+ * a display (e.g. on Mesa's llvmpipe). This needs a build with EGL.
  */
 class Window {
 public:
   Window();
+  Window(int width, int height); // headless
   ~Window();
 
   // Returns true if the application should quit.
@@ -30,17 +43,46 @@ public:
 
   inline int getWidth() const { return _width; }
   inline int getHeight() const { return _height; }
+  inline bool isHeadless() const { return _headless; }
 
+  // Framebuffer object of the canvas (0 for the window's own).
+  inline unsigned getFramebuffer() const { return _framebuffer; }
+
+  // Presents the frame; when headless, waits for it to finish instead.
   void swapBuffers();
 
+  // Sets the number of vertical blanks a swap waits for (0 for none, -1 for
+  // adaptive v-sync), on the thread that owns the GL context. Returns false
+  // if the interval isn't supported. Headless swaps never wait.
+  bool setSwapInterval(int interval);
+
+  // Refresh rate of the display showing the window in Hz, or 0 if unknown.
+  int getRefreshRate();
+
+  // Reads the canvas as 8-bit RGBA, top row first.
+  void readPixels(std::vector<unsigned char>& pixels);
+
+  // Binds the GL context to the calling thread, or unbinds it so that
+  // another thread can take it.
+  void makeContextCurrent();
+  void releaseContext();
+
 private:
+  void logInfo();
   void die(const char* what);
 
 private:
   int _width, _height;
-  SDL_Window* _window;
-  SDL_GLContext _context;
+  SDL_Window* _window = nullptr;
+  SDL_GLContext _context = nullptr;
   std::shared_ptr<spdlog::logger> _logger;
+
+  // headless
+  bool _headless = false;
+  void* _eglDisplay = nullptr;
+  void* _eglContext = nullptr;
+  unsigned _framebuffer = 0;
+  unsigned _renderbuffer = 0;
 };
 
 #endif // _WINDOW_H_
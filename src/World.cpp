@@ -1,27 +1,79 @@
 #include "World.h"
 #include "BoxTable.h"
+#include "JobTaskScheduler.h"
+#include "PhysicsAllocator.h"
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <spdlog/spdlog.h>
 #include <sqlpp11/sqlite3/sqlite3.h>
 #include <sqlpp11/sqlpp11.h>
 
 namespace sql = sqlpp::sqlite3;
 
-World::World() {
+namespace {
+// local to this file: Shader.cpp has a getLogger() of its own
+auto getLogger() {
+  static std::shared_ptr<spdlog::logger> s_logger;
+  if (!s_logger)
+    s_logger = spdlog::stdout_logger_mt("world", true /*use color*/);
+  return s_logger;
+}
+}
+
+// boxes per job when fanning out over all boxes
+const size_t BOX_GRAIN = 1024;
+
+World::World(JobSystem& jobs) : _jobs(jobs) {
   // empty
 }
 
 World::~World() {
-  // empty
+  // the dynamics world still refers to the bodies until it is gone
+  _dynamicsWorld.reset();
+  for (auto& box : _boxes) {
+    _bodyPool.destroy(box.body);
+    _motionStatePool.destroy(box.pose);
+  }
+
+  // Bullet refers to the scheduler through a global
+  if (_taskScheduler)
+    btSetTaskScheduler(btGetSequentialTaskScheduler());
 }
 
 void World::initPhysics() {
+  PhysicsAllocator::Scope scope(PhysicsAllocator::Setup);
+  if (_jobs.getNumThreads() > 1) {
+#if BT_THREADSAFE
+    _taskScheduler.reset(new JobTaskScheduler(_jobs));
+    btSetTaskScheduler(_taskScheduler.get());
+#else
+    getLogger()->warn()
+        << "Bullet is not thread safe, simulating on a single thread";
+#endif
+  }
+
   // dynamics world
   _broadphase.reset(new btDbvtBroadphase());
   _collisionConfiguration.reset(new btDefaultCollisionConfiguration());
-  _dispatcher.reset(new btCollisionDispatcher(_collisionConfiguration.get()));
-  _solver.reset(new btSequentialImpulseConstraintSolver());
-  _dynamicsWorld.reset(new btDiscreteDynamicsWorld(
-      _dispatcher.get(), _broadphase.get(), _solver.get(),
-      _collisionConfiguration.get()));
+  if (_taskScheduler) {
+    // one solver per thread, each taking whole islands of bodies
+    _dispatcher.reset(new btCollisionDispatcherMt(
+        _collisionConfiguration.get()));
+    _solverPool.reset(
+        new btConstraintSolverPoolMt(_taskScheduler->getNumThreads()));
+    _solver.reset(new btSequentialImpulseConstraintSolverMt());
+    _dynamicsWorld.reset(new btDiscreteDynamicsWorldMt(
+        _dispatcher.get(), _broadphase.get(), _solverPool.get(),
+        _solver.get(), _collisionConfiguration.get()));
+  } else {
+    _dispatcher.reset(
+        new btCollisionDispatcher(_collisionConfiguration.get()));
+    _solver.reset(new btSequentialImpulseConstraintSolver());
+    _dynamicsWorld.reset(new btDiscreteDynamicsWorld(
+        _dispatcher.get(), _broadphase.get(), _solver.get(),
+        _collisionConfiguration.get()));
+  }
   _dynamicsWorld->setGravity(btVector3(0, -9.8, 0));
 
   // ground
@@ -38,29 +90,145 @@ void World::initPhysics() {
   _boxShape.reset(new btBoxShape(btVector3(0.5, 0.5, 0.5)));
 }
 
-World::Box& World::addBox(const btVector3& pos, float yaw, float pitch,
-                          float roll, const glm::vec3& color) {
-  // physics
+bool World::isThreadSafe() {
+#if BT_THREADSAFE
+  return true;
+#else
+  return false;
+#endif
+}
+
+int World::getNumThreads() const {
+  return _taskScheduler ? _taskScheduler->getNumThreads() : 1;
+}
+
+World::Handle World::addBox(const btVector3& pos, float yaw, float pitch,
+                            float roll, const glm::vec3& color) {
+  PhysicsAllocator::Scope scope(PhysicsAllocator::Bodies);
+  // the motion state gives the body its initial pose
+  Handle handle = _boxSlots.insert();
+  int index = _boxes.size();
   btTransform transform(btQuaternion(yaw, pitch, roll), pos);
-  std::unique_ptr<btMotionState> pose(new btDefaultMotionState(transform));
-  std::unique_ptr<btRigidBody> body(
-      new btRigidBody(btRigidBody::btRigidBodyConstructionInfo(
-          1, pose.get(), _boxShape.get())));
+  _previousPoses.push_back(transform);
+  _currentPoses.push_back(transform);
+  BoxMotionState* pose = _motionStatePool.create(*this, index);
+  btRigidBody* body = _bodyPool.create(
+      btRigidBody::btRigidBodyConstructionInfo(1, pose, _boxShape.get()));
   body->setFriction(1.1f);
-  _dynamicsWorld->addRigidBody(body.get());
+  body->setUserIndex(index);
+  _dynamicsWorld->addRigidBody(body);
+  _boxes.push_back(Box{pose, body});
 
-  _boxes.emplace_back(Box{std::move(pose), std::move(body), color});
-  return _boxes.back();
+  _states.positions.push_back(transform.getOrigin());
+  _states.rotations.push_back(transform.getRotation());
+  _states.velocities.push_back(btVector3(0, 0, 0));
+  _states.colors.push_back(color);
+  _states.active.push_back(0);
+  return handle;
 }
 
-World::Box& World::addRandomBox(const glm::vec3& pos) {
+World::Handle World::addRandomBox(const glm::vec3& pos) {
   glm::vec3 color(_rand(_mt), _rand(_mt), _rand(_mt));
   return addBox(btVector3(pos.x, pos.y, pos.z), _rand(_mt) * btRadians(90.0f),
                 0, 0, color);
 }
 
-void World::update(float dt, float timeStep) {
-  _dynamicsWorld->stepSimulation(dt, 5, timeStep);
+void World::step(float timeStep) {
+  PhysicsAllocator::Scope scope(PhysicsAllocator::Simulation);
+
+  // boxes that moved in the last step stay where they are, unless Bullet
+  // moves them again (see boxMoved), and bodies at rest aren't visited
+  for (Handle handle : _movedBoxes) {
+    int i = _boxSlots.indexOf(handle);
+    if (i < 0) // removed since
+      continue;
+    _previousPoses[i] = _currentPoses[i];
+    _states.velocities[i].setZero();
+    _states.active[i] = 0;
+  }
+  _movedBoxes.clear();
+
+  _dynamicsWorld->stepSimulation(timeStep, 1, timeStep);
+}
+
+namespace {
+// Removes element `index` of `array` by moving the last one into its place,
+// as SlotMap::remove does.
+template <typename T>
+void removeSwap(std::vector<T>& array, int index) {
+  array[index] = std::move(array.back());
+  array.pop_back();
+}
+}
+
+bool World::removeBox(Handle handle) {
+  int index = _boxSlots.indexOf(handle);
+  if (index < 0)
+    return false;
+
+  Box box = _boxes[index];
+  _dynamicsWorld->removeRigidBody(box.body);
+  _bodyPool.destroy(box.body);
+  _motionStatePool.destroy(box.pose);
+
+  _boxSlots.remove(handle);
+  removeSwap(_boxes, index);
+  removeSwap(_previousPoses, index);
+  removeSwap(_currentPoses, index);
+  removeSwap(_states.positions, index);
+  removeSwap(_states.rotations, index);
+  removeSwap(_states.velocities, index);
+  removeSwap(_states.colors, index);
+  removeSwap(_states.active, index);
+  if (index < static_cast<int>(_boxes.size())) {
+    // the box that was last
+    _boxes[index].body->setUserIndex(index);
+    _boxes[index].pose->setIndex(index);
+  }
+  return true;
+}
+
+// Called by Bullet, on the stepping thread, for every box that is still
+// active after a step.
+void World::boxMoved(int index, const btTransform&) {
+  // read the simulated transform rather than the one given, which Bullet
+  // interpolates
+  const btRigidBody& body = *_boxes[index].body;
+  const btTransform& transform = body.getWorldTransform();
+  _currentPoses[index] = transform;
+  _states.positions[index] = transform.getOrigin();
+  _states.rotations[index] = transform.getRotation();
+  _states.velocities[index] = body.getLinearVelocity();
+  if (!_states.active[index]) {
+    _states.active[index] = 1;
+    _movedBoxes.push_back(_boxSlots.getHandles()[index]);
+  }
+}
+
+namespace {
+// Collects the box indices of the tree leaves reached by a query.
+struct CollectBoxes : btDbvt::ICollide {
+  explicit CollectBoxes(std::vector<int>& result) : result(result) {}
+
+  void Process(const btDbvtNode* leaf) override {
+    auto proxy = static_cast<const btDbvtProxy*>(leaf->data);
+    auto object = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+    int index = object->getUserIndex();
+    if (index >= 0) // skip the ground and other non-box objects
+      result.push_back(index);
+  }
+
+  std::vector<int>& result;
+};
+}
+
+void World::queryVolume(const btVector3* normals, const btScalar* offsets,
+                        int count, std::vector<int>& result) const {
+  PhysicsAllocator::Scope scope(PhysicsAllocator::Queries);
+  CollectBoxes collect(result);
+  // objects that stopped moving are kept in the second (fixed) set
+  for (const auto& set : _broadphase->m_sets)
+    btDbvt::collideKDOP(set.m_root, normals, offsets, count, collect);
 }
 
 sql::connection_config getDbConfig() {
@@ -96,22 +264,34 @@ void World::save() {
   sql::connection db(getDbConfig());
   box_db::Box tbl;
 
+  // convert the rotations in parallel; the connection is used by this
+  // thread only
+  struct Angles {
+    float yaw, pitch, roll;
+  };
+  std::vector<Angles> angles(_boxes.size());
+  _jobs.parallelFor(0, angles.size(), BOX_GRAIN,
+                    [&](size_t first, size_t last) {
+                      for (size_t i = first; i < last; ++i) {
+                        Angles& a = angles[i];
+                        btMatrix3x3(_states.rotations[i])
+                            .getEulerYPR(a.yaw, a.pitch, a.roll);
+                      }
+                    });
+
   // clear the table
   db(remove_from(tbl).unconditionally());
 
   // insert all boxes
-  for (const auto& box : _boxes) {
-    btTransform trans;
-    box.pose->getWorldTransform(trans);
-    auto& p = trans.getOrigin();
-    float yaw, pitch, roll;
-    trans.getBasis().getEulerYPR(yaw, pitch, roll);
-    auto& c = box.color;
+  for (size_t i = 0; i < angles.size(); ++i) {
+    auto& p = _states.positions[i];
+    auto& c = _states.colors[i];
     db(insert_into(tbl).set(
         // position
         tbl.x = p.x(), tbl.y = p.y(), tbl.z = p.z(),
         // orientation
-        tbl.yaw = yaw, tbl.pitch = pitch, tbl.roll = roll,
+        tbl.yaw = angles[i].yaw, tbl.pitch = angles[i].pitch,
+        tbl.roll = angles[i].roll,
         // color
         tbl.red = c.r, tbl.green = c.g, tbl.blue = c.b));
   }
@@ -1,43 +1,141 @@
 #ifndef _WORLD_H_
 #define _WORLD_H_
 
+#include "Pool.h"
+#include "SlotMap.h"
 #include <btBulletDynamicsCommon.h>
+#include <LinearMath/btThreads.h>
 #include <glm/vec3.hpp>
 #include <memory>
 #include <random>
 #include <vector>
 
+class JobSystem;
+class btConstraintSolverPoolMt;
+
 /*
  * World containing boxes with physical simulation.
+ *
+ * Parallel work, including Bullet's own, runs on the given JobSystem. When
+ * the PhysicsAllocator is installed, Bullet's memory is counted under what
+ * the World is doing: setting up, adding boxes, stepping or querying.
  */
 class World {
 public:
-  World();
+  explicit World(JobSystem& jobs);
   ~World();
 
+  // Creates the dynamics world. When the JobSystem has more than one
+  // thread, collision detection and constraint solving run in parallel on
+  // it; that needs Bullet built with BT_THREADSAFE, and otherwise falls back
+  // to a single thread.
   void initPhysics();
 
+  // Threads used by the simulation.
+  int getNumThreads() const;
+
+  // Whether Bullet was built with BT_THREADSAFE, so that the simulation can
+  // use more than one thread.
+  static bool isThreadSafe();
+
+  class BoxMotionState;
+
+  // The motion state and body live in the World's pools.
   struct Box {
-    std::unique_ptr<btMotionState> pose;
-    std::unique_ptr<btRigidBody> body;
-    glm::vec3 color;
+    BoxMotionState* pose;
+    btRigidBody* body;
   };
 
+  // Boxes are kept densely packed: removing one moves the last box into its
+  // index, so indices only hold until the next removeBox(). Handles remain
+  // valid until their box is removed.
+  using Handle = SlotMap::Handle;
   const std::vector<Box>& getBoxes() const { return _boxes; }
+  const std::vector<Handle>& getBoxHandles() const {
+    return _boxSlots.getHandles();
+  }
+  // Index of the box, or -1 if it was removed.
+  int findBox(Handle handle) const { return _boxSlots.indexOf(handle); }
+
+  // The state of every box (indexed like getBoxes()) as flat arrays, for
+  // passes over all boxes that need neither Bullet nor its virtual calls.
+  // A step only writes the boxes that move or have just stopped.
+  struct BoxStates {
+    std::vector<btVector3> positions;
+    std::vector<btQuaternion> rotations;
+    std::vector<btVector3> velocities; // linear
+    std::vector<glm::vec3> colors;
+    std::vector<unsigned char> active; // moved in the last step
+  };
+  const BoxStates& getBoxStates() const { return _states; }
+
+  // Poses of the boxes (indexed like getBoxes()) before and after the last
+  // step(), to be interpolated for rendering.
+  const std::vector<btTransform>& getPreviousPoses() const {
+    return _previousPoses;
+  }
+  const std::vector<btTransform>& getCurrentPoses() const {
+    return _currentPoses;
+  }
+
+  Handle addBox(const btVector3& pos, float yaw, float pitch, float roll,
+                const glm::vec3& color);
+  Handle addRandomBox(const glm::vec3& pos);
+
+  // Takes the box out of the simulation and frees it; returns false if it
+  // was already removed.
+  bool removeBox(Handle handle);
 
-  Box& addBox(const btVector3& pos, float yaw, float pitch, float roll,
-              const glm::vec3& color);
-  Box& addRandomBox(const glm::vec3& pos);
+  // Advances the simulation by exactly one step of `timeStep` seconds.
+  void step(float timeStep);
 
-  void update(float dt, float timeStep);
+  // Receives the transforms Bullet sets on the bodies that moved in a step.
+  class BoxMotionState : public btMotionState {
+  public:
+    BoxMotionState(World& world, int index) : _world(world), _index(index) {}
+
+    void setIndex(int index) { _index = index; }
+
+    void getWorldTransform(btTransform& transform) const override {
+      transform = _world._currentPoses[_index];
+    }
+    void setWorldTransform(const btTransform& transform) override {
+      _world.boxMoved(_index, transform);
+    }
+
+  private:
+    World& _world;
+    int _index;
+  };
+
+  /*
+   * Appends to `result` the indices (into getBoxes()) of the boxes whose
+   * bounding box intersects the convex volume bounded by `count` planes,
+   * where points p inside satisfy dot(normals[i], p) + offsets[i] >= 0.
+   * Walks the broadphase's dynamic AABB tree, so whole subtrees outside the
+   * volume are rejected at once.
+   */
+  void queryVolume(const btVector3* normals, const btScalar* offsets,
+                   int count, std::vector<int>& result) const;
 
   // persistence
   void load();
   void save();
 
 private:
-  // boxes
+  void boxMoved(int index, const btTransform& transform);
+
+private:
+  JobSystem& _jobs;
+
+  // boxes, created in chunks so that passes over them walk memory in order
+  Pool<BoxMotionState> _motionStatePool;
+  Pool<btRigidBody> _bodyPool;
+  SlotMap _boxSlots;
   std::vector<Box> _boxes;
+  std::vector<btTransform> _previousPoses, _currentPoses;
+  BoxStates _states;
+  std::vector<Handle> _movedBoxes; // in the last step
   std::unique_ptr<btCollisionShape> _boxShape;
 
   // ground
@@ -46,10 +144,12 @@ private:
   std::unique_ptr<btRigidBody> _groundRigidBody;
 
   // dynamics world
-  std::unique_ptr<btBroadphaseInterface> _broadphase;
+  std::unique_ptr<btITaskScheduler> _taskScheduler; // when multithreaded
+  std::unique_ptr<btDbvtBroadphase> _broadphase;
   std::unique_ptr<btDefaultCollisionConfiguration> _collisionConfiguration;
   std::unique_ptr<btCollisionDispatcher> _dispatcher;
-  std::unique_ptr<btSequentialImpulseConstraintSolver> _solver;
+  std::unique_ptr<btConstraintSolverPoolMt> _solverPool;
+  std::unique_ptr<btConstraintSolver> _solver;
   std::unique_ptr<btDiscreteDynamicsWorld> _dynamicsWorld;
 
   // pseudo-random number gen
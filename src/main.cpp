@@ -1,57 +1,603 @@
 #include "Graphics.h"
+#include "JobSystem.h"
+#include "PhysicsAllocator.h"
+#include "Png.h"
+#include "Quantize.h"
+#include "RenderThread.h"
 #include "Window.h"
 #include "World.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
 
 using namespace std::chrono_literals;
 
-// use a fixed time step of 66.66Hz = 15 milliseconds
-constexpr std::chrono::duration<double> timeStep(15ms);
+// upper bound for the simulation loop, which no longer waits for vsync
+constexpr std::chrono::duration<double> minFrameTime(1s / 240.0);
 
-int main(int, char* []) {
-  World world;
-  Window window;
-  Graphics graphics(world);
+// how often the interactive loop logs rendering statistics
+constexpr std::chrono::seconds statsInterval(5);
+
+struct Options {
+  // simulation steps per second, by default 66.66Hz = 15 milliseconds
+  double stepRate = 1000.0 / 15.0;
+  int threads = 0; // of the JobSystem, 0 for one per hardware thread
+  FramePacer::Mode pacing = FramePacer::VSync;
+  bool hugePages = false; // for Bullet's memory
+
+  // physics benchmark, stepping with up to this many threads
+  int physicsScaling = 0;
+
+  // box storage benchmark, with this many boxes
+  int storageBoxes = 0;
+
+  // headless benchmark
+  bool headless = false;
+  int width = 1280, height = 720;
+  int frames = 600; // also the number of physics benchmark steps
+  std::string timingsFile;    // per-frame times, as CSV
+  std::string screenshotFile; // final frame, as PNG
+  InstanceFormat instanceFormat = TransformInstances;
+  CubeMesh cubeMesh = IndexedCube;
+};
+
+// --instances values, per InstanceFormat
+const char* const INSTANCE_FORMAT_NAMES[] = {"matrix", "transform",
+                                             "quantized"};
+
+// --cube values, per CubeMesh
+const char* const CUBE_MESH_NAMES[] = {"indexed", "arrays"};
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (std::strcmp(arg, "--rate") == 0 && value) {
+      options.stepRate = std::atof(value);
+      ++i;
+    } else if (std::strcmp(arg, "--threads") == 0 && value) {
+      options.threads = std::atoi(value);
+      ++i;
+    } else if (std::strcmp(arg, "--physics-scaling") == 0 && value) {
+      options.physicsScaling = std::atoi(value);
+      ++i;
+    } else if (std::strcmp(arg, "--storage-benchmark") == 0 && value) {
+      options.storageBoxes = std::atoi(value);
+      ++i;
+    } else if (std::strcmp(arg, "--pacing") == 0 && value) {
+      int mode = 0;
+      while (mode < FramePacer::ModeCount &&
+             std::strcmp(FramePacer::getModeName(
+                             static_cast<FramePacer::Mode>(mode)),
+                         value) != 0)
+        ++mode;
+      if (mode == FramePacer::ModeCount)
+        return false;
+      options.pacing = static_cast<FramePacer::Mode>(mode);
+      ++i;
+    } else if (std::strcmp(arg, "--huge-pages") == 0) {
+      options.hugePages = true;
+    } else if (std::strcmp(arg, "--headless") == 0) {
+      options.headless = true;
+      if (value && std::sscanf(value, "%dx%d", &options.width,
+                               &options.height) == 2)
+        ++i;
+    } else if (std::strcmp(arg, "--frames") == 0 && value) {
+      options.frames = std::atoi(value);
+      ++i;
+    } else if (std::strcmp(arg, "--timings") == 0 && value) {
+      options.timingsFile = value;
+      ++i;
+    } else if (std::strcmp(arg, "--screenshot") == 0 && value) {
+      options.screenshotFile = value;
+      ++i;
+    } else if (std::strcmp(arg, "--instances") == 0 && value) {
+      auto name = std::find_if(
+          std::begin(INSTANCE_FORMAT_NAMES), std::end(INSTANCE_FORMAT_NAMES),
+          [&](const char* n) { return std::strcmp(n, value) == 0; });
+      if (name == std::end(INSTANCE_FORMAT_NAMES))
+        return false;
+      options.instanceFormat = static_cast<InstanceFormat>(
+          name - std::begin(INSTANCE_FORMAT_NAMES));
+      ++i;
+    } else if (std::strcmp(arg, "--cube") == 0 && value) {
+      auto name = std::find_if(
+          std::begin(CUBE_MESH_NAMES), std::end(CUBE_MESH_NAMES),
+          [&](const char* n) { return std::strcmp(n, value) == 0; });
+      if (name == std::end(CUBE_MESH_NAMES))
+        return false;
+      options.cubeMesh =
+          static_cast<CubeMesh>(name - std::begin(CUBE_MESH_NAMES));
+      ++i;
+    } else {
+      return false;
+    }
+  }
+  return options.stepRate > 0.0 && options.threads >= 0 &&
+         options.physicsScaling >= 0 && options.storageBoxes >= 0 &&
+         options.width > 0 && options.height > 0 && options.frames > 0;
+}
+
+// 64-bit FNV-1a
+static uint64_t hash(const std::vector<unsigned char>& data) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char byte : data)
+    h = (h ^ byte) * 1099511628211ull;
+  return h;
+}
+
+struct QuantizationError {
+  float maxDistance = 0.0f; // in world units
+  float maxPixels = 0.0f;   // projected onto the screen
+};
+
+// Measures how far the corners of the boxes move when they are streamed as
+// QuantizedInstances in `frame`.
+static QuantizationError measureQuantization(const World& world,
+                                             const FramePacket& frame) {
+  QuantizationError error;
+  auto& poses = world.getCurrentPoses();
+  auto& colors = world.getBoxStates().colors;
+  for (size_t i = 0; i < poses.size(); ++i) {
+    const btTransform& exact = poses[i];
+    QuantizedBoxInstance instance;
+    quantizeBox(exact, colors[i], frame.viewPos, instance);
+    btTransform decoded;
+    glm::vec3 color;
+    dequantizeBox(instance, frame.viewPos, decoded, color);
+
+    for (int corner = 0; corner < 8; ++corner) {
+      btVector3 local((corner & 1) ? 0.5f : -0.5f,
+                      (corner & 2) ? 0.5f : -0.5f,
+                      (corner & 4) ? 0.5f : -0.5f);
+      btVector3 position = exact * local;
+      float distance = position.distance(decoded * local);
+      float viewDistance = glm::distance(
+          frame.viewPos, glm::vec3(position.x(), position.y(), position.z()));
+      error.maxDistance = std::max(error.maxDistance, distance);
+      if (viewDistance > 1.0f) { // beyond the near plane
+        error.maxPixels = std::max(
+            error.maxPixels, distance * frame.pointScale / viewDistance);
+      }
+    }
+  }
+  return error;
+}
+
+// Logs how much work each thread of `jobs` has done.
+static void logJobStats(spdlog::logger& logger, const JobSystem& jobs) {
+  auto stats = jobs.getStats();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    logger.info() << "Job thread " << i << ": " << stats[i].jobs << " jobs, "
+                  << stats[i].steals << " stolen, "
+                  << stats[i].utilization * 100.0 << "% busy";
+  }
+}
+
+// Logs the live physics memory per category, and how many allocations per
+// second were made in the `seconds` since `start` was taken.
+static void logPhysicsMemory(spdlog::logger& logger,
+                             const PhysicsAllocator::Stats& start,
+                             double seconds) {
+  auto stats = PhysicsAllocator::getStats();
+  for (int i = 0; i < PhysicsAllocator::CategoryCount; ++i) {
+    auto& category = stats.categories[i];
+    uint64_t allocations =
+        category.totalAllocations - start.categories[i].totalAllocations;
+    logger.info() << "Physics memory ("
+                  << PhysicsAllocator::getCategoryName(
+                         static_cast<PhysicsAllocator::Category>(i))
+                  << "): " << category.bytes / 1048576.0 << " MiB in "
+                  << category.blocks << " blocks, "
+                  << allocations / std::max(seconds, 1e-9)
+                  << " allocations/s";
+  }
+  logger.info() << "Physics memory reserved: "
+                << stats.reservedBytes / 1048576.0 << " MiB"
+                << (stats.hugePages ? " in huge pages" : "");
+}
+
+// Logs the box counts of a frame.
+static void logRenderStats(spdlog::logger& logger,
+                           const Graphics::RenderStats& stats) {
+  logger.info() << "Boxes: " << stats.visibleBoxes << " visible, "
+                << stats.culledBoxes << " outside the view, "
+                << stats.occludedBoxes << " occluded; drawn as "
+                << stats.lodBoxes[FramePacket::Full] << " full, "
+                << stats.lodBoxes[FramePacket::Simple] << " simple, "
+                << stats.lodBoxes[FramePacket::Impostor] << " impostors";
+}
+
+// Logs the GL calls made by the render queue in a frame.
+static void logQueueStats(spdlog::logger& logger,
+                          const RenderQueue::Stats& stats) {
+  logger.info() << "Render queue: " << stats.draws << " draws, "
+                << stats.stateChanges << " state changes, "
+                << stats.programBinds << " program, " << stats.vaoBinds
+                << " VAO and " << stats.bufferBinds << " buffer binds";
+}
+
+// Logs how often streaming instances had to wait for the GPU.
+static void logStreamStats(spdlog::logger& logger,
+                           const StreamBuffer::Stats& stats) {
+  logger.info() << "Instance stream: " << stats.stalls << " stalls in "
+                << stats.frames << " frames, "
+                << stats.stallSeconds * 1000.0 << " ms waiting for the GPU";
+}
+
+// Renders a fixed number of frames offscreen, each a single simulation step
+// later, and reports the frame times and a hash of the final image.
+static int runBenchmark(const Options& options) {
+  auto logger = spdlog::stdout_logger_mt("benchmark", true /*use color*/);
+
+  JobSystem jobs(options.threads);
+  World world(jobs);
+  Window window(options.width, options.height);
+  Graphics graphics(world, jobs);
+
+  // a fixed resolution, for comparable timings and images
+  ResolutionSettings resolution;
+  resolution.dynamic = false;
+  graphics.setResolutionSettings(resolution);
+  graphics.setInstanceFormat(options.instanceFormat);
+  graphics.setCubeMesh(options.cubeMesh);
 
   world.initPhysics();
   world.load();
 
-  // track rendering time and update state at a fixed timestep
+  // the frame and GPU times below are those of this mesh; compare runs
+  // with --cube indexed and --cube arrays
+  logger->info() << "Rendering " << options.frames << " frames with the "
+                 << CUBE_MESH_NAMES[options.cubeMesh] << " cube mesh";
+
+  // simulate, prepare and render every frame on this thread, so that the
+  // output only depends on the number of frames
+  using clock = std::chrono::high_resolution_clock;
+  const float timeStep = 1.0 / options.stepRate;
+  FramePacket frame;
+  std::vector<double> frameTimes;
+  std::vector<Graphics::RenderStats> frameStats;
+  jobs.resetStats();
+  auto memory = PhysicsAllocator::getStats();
+  for (int i = 0; i < options.frames; ++i) {
+    auto start = clock::now();
+    world.step(timeStep);
+    graphics.update(timeStep);
+    graphics.prepareFrame(frame, window.getWidth(), window.getHeight());
+    graphics.render(frame, window.getFramebuffer());
+    window.swapBuffers();
+    std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+    frameTimes.push_back(elapsed.count());
+    frameStats.push_back(graphics.getRenderStats());
+  }
+
+  if (!options.timingsFile.empty()) {
+    std::ofstream file(options.timingsFile);
+    file << "frame,milliseconds,visible,culled,occluded,full,simple,"
+            "impostor\n";
+    for (size_t i = 0; i < frameTimes.size(); ++i) {
+      const Graphics::RenderStats& stats = frameStats[i];
+      file << i << ',' << frameTimes[i] << ',' << stats.visibleBoxes << ','
+           << stats.culledBoxes << ',' << stats.occludedBoxes;
+      for (size_t boxes : stats.lodBoxes)
+        file << ',' << boxes;
+      file << '\n';
+    }
+    if (!file)
+      logger->error() << "Failed to write " << options.timingsFile;
+  }
+
+  std::vector<double> sorted(frameTimes);
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&](double p) {
+    return sorted[std::min<size_t>(p * sorted.size(), sorted.size() - 1)];
+  };
+  double total = 0.0;
+  for (double time : sorted)
+    total += time;
+  logger->info() << sorted.size() << " frames in " << total << " ms: "
+                 << "average " << total / sorted.size() << " ms, p50 "
+                 << percentile(0.5) << " ms, p95 " << percentile(0.95)
+                 << " ms, p99 " << percentile(0.99) << " ms";
+  for (auto& pass : graphics.getGpuProfiler().getPassStats()) {
+    logger->info() << "GPU " << pass.name << ": average "
+                   << pass.time.average << " ms, p95 " << pass.time.p95
+                   << " ms";
+  }
+  logRenderStats(*logger, frameStats.back());
+  logger->info() << "Resolution scale: " << graphics.getResolutionScale()
+                 << " (fixed)";
+  logQueueStats(*logger, graphics.getQueueStats());
+  logJobStats(*logger, jobs);
+  logPhysicsMemory(*logger, memory, total / 1000.0);
+
+  // instance bandwidth, and the precision lost by quantizing instances
+  const StreamBuffer::Stats& stream = graphics.getStreamStats();
+  logger->info() << "Instances (" << INSTANCE_FORMAT_NAMES[frame.instanceFormat]
+                 << "): " << instanceSize(frame.instanceFormat)
+                 << " bytes per box, "
+                 << stream.bytes / 1024.0 / std::max<uint64_t>(stream.frames, 1)
+                 << " KiB streamed per frame";
+  logStreamStats(*logger, stream);
+  QuantizationError error = measureQuantization(world, frame);
+  logger->info() << "Quantized instance error: " << error.maxDistance
+                 << " units, " << error.maxPixels << " pixels at most";
+
+  std::vector<unsigned char> pixels;
+  window.readPixels(pixels);
+  std::ostringstream imageHash;
+  imageHash << std::hex << std::setw(16) << std::setfill('0') << hash(pixels);
+  logger->info() << "Final frame hash: " << imageHash.str();
+  if (!options.screenshotFile.empty() &&
+      !writePng(options.screenshotFile, window.getWidth(), window.getHeight(),
+                pixels)) {
+    logger->error() << "Failed to write " << options.screenshotFile;
+    return 1;
+  }
+
+  // the world is not saved, so every run starts from the same state
+  return 0;
+}
+
+// Drops a pile of boxes, tilted so that they topple and keep colliding, into
+// `world`.
+static void dropPile(World& world) {
+  const int PILE_SIZE = 32, PILE_HEIGHT = 10; // 10240 boxes
+  for (int y = 0; y < PILE_HEIGHT; ++y) {
+    for (int x = 0; x < PILE_SIZE; ++x) {
+      for (int z = 0; z < PILE_SIZE; ++z) {
+        btVector3 position((x - PILE_SIZE / 2) * 1.2f, 1.0f + y * 1.5f,
+                           (z - PILE_SIZE / 2) * 1.2f);
+        float tilt = (x * 7 + y * 5 + z * 3) % 11 * 0.05f;
+        world.addBox(position, tilt, tilt, 0.0f, glm::vec3(0.5f));
+      }
+    }
+  }
+}
+
+// Steps the same pile of boxes with one up to `physicsScaling` threads, and
+// reports the time per step and the speedup over a single thread.
+static int runPhysicsScaling(const Options& options) {
+  auto logger = spdlog::stdout_logger_mt("benchmark", true /*use color*/);
+  if (!World::isThreadSafe()) {
+    // every run would step on a single thread
+    logger->error() << "Physics scaling needs Bullet built with "
+                       "BT_THREADSAFE (configure with -DBULLET_THREADSAFE=ON)";
+    return 1;
+  }
   using clock = std::chrono::high_resolution_clock;
-  auto timeCurrent = clock::now();
-  std::chrono::duration<double> timeAccum(0s);
+  const float timeStep = 1.0 / options.stepRate;
 
-  // game loop
+  // a single pool, taking in more of its threads each run, since Bullet
+  // numbers the threads it has seen for the whole process (see
+  // JobTaskScheduler)
+  JobSystem jobs(options.physicsScaling);
+  double baseline = 0.0;
+  int threads = 1;
   while (true) {
-    if (window.handleEvents(graphics))
+    jobs.setNumThreads(threads);
+    World world(jobs);
+    world.initPhysics();
+    dropPile(world);
+
+    jobs.resetStats();
+    auto memory = PhysicsAllocator::getStats();
+    auto start = clock::now();
+    for (int i = 0; i < options.frames; ++i)
+      world.step(timeStep);
+    std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+
+    double stepTime = elapsed.count() / options.frames;
+    if (threads == 1)
+      baseline = stepTime;
+    logger->info() << world.getNumThreads() << " threads: " << stepTime
+                   << " ms per step, " << baseline / stepTime
+                   << "x speedup";
+    logJobStats(*logger, jobs);
+    logPhysicsMemory(*logger, memory, elapsed.count() / 1000.0);
+
+    // powers of two, and the maximum
+    if (threads == options.physicsScaling)
       break;
+    threads = std::min(threads * 2, options.physicsScaling);
+  }
+  return 0;
+}
 
-    auto now = clock::now();
-    std::chrono::duration<double> timeDelta = now - timeCurrent;
-    if (timeDelta > 0.25s)
-      timeDelta = 0.25s;
-    timeCurrent = now;
-    timeAccum += timeDelta;
-
-    // update game state
-    world.update(timeDelta.count(), timeStep.count());
-    /* while (timeAccum >= timeStep) { */
-    /*   timeAccum -= timeStep; */
-    /*   update(timeStep.count()); */
-    /* } */
-    /* // calculate alpha to interpolate between prev_state and curr_state */
-    /* double time_alpha = time_accum.count() / time_step.count(); */
-    /* auto render_state = interpolate(prev_state, curr_state, alpha); */
-    /* render(render_state); */
-
-    graphics.update(timeDelta.count());
-    graphics.render(window);
-    window.swapBuffers();
+// Creates box bodies and motion states once with a heap allocation each, as
+// World used to, and once from Pools, and reports the time to create them
+// and to read all their transforms, per box. Runs without the
+// PhysicsAllocator, which would otherwise serve the heap variant from its
+// size classes too.
+static int runStorageBenchmark(const Options& options) {
+  auto logger = spdlog::stdout_logger_mt("benchmark", true /*use color*/);
+  using clock = std::chrono::high_resolution_clock;
+  using nanoseconds = std::chrono::duration<double, std::nano>;
+  const size_t count = options.storageBoxes;
+  const int passes = options.frames;
+  btBoxShape shape(btVector3(0.5, 0.5, 0.5));
+
+  // both variants keep their boxes in the order they were created
+  auto measure = [&](const char* name, auto create, auto& boxes) {
+    auto start = clock::now();
+    for (size_t i = 0; i < count; ++i) {
+      btTransform transform(btQuaternion(i * 0.1f, 0, 0),
+                            btVector3(i % 100, i / 10000, i / 100 % 100));
+      create(transform);
+    }
+    nanoseconds spawn = clock::now() - start;
+
+    // the body's own transform, as World::step reads it, and the virtual
+    // motion state call
+    btVector3 sum(0, 0, 0);
+    start = clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+      for (auto& box : boxes) {
+        btTransform pose;
+        box.first->getWorldTransform(pose);
+        sum += pose.getOrigin() + box.second->getWorldTransform().getOrigin();
+      }
+    }
+    nanoseconds iterate = clock::now() - start;
+
+    double reads = static_cast<double>(count) * passes;
+    logger->info() << name << ": " << spawn.count() / count
+                   << " ns to create a box, " << iterate.count() / reads
+                   << " ns to read it (checksum " << sum.length() << ")";
+  };
+
+  {
+    std::vector<std::unique_ptr<btDefaultMotionState>> poses;
+    std::vector<std::unique_ptr<btRigidBody>> bodies;
+    std::vector<std::pair<btMotionState*, btRigidBody*>> boxes;
+    measure("Heap", [&](const btTransform& transform) {
+      poses.emplace_back(new btDefaultMotionState(transform));
+      bodies.emplace_back(new btRigidBody(
+          btRigidBody::btRigidBodyConstructionInfo(1, poses.back().get(),
+                                                   &shape)));
+      boxes.emplace_back(poses.back().get(), bodies.back().get());
+    }, boxes);
+  }
+
+  {
+    Pool<btDefaultMotionState> poses;
+    Pool<btRigidBody> bodies;
+    std::vector<std::pair<btMotionState*, btRigidBody*>> boxes;
+    measure("Pool", [&](const btTransform& transform) {
+      btDefaultMotionState* pose = poses.create(transform);
+      boxes.emplace_back(pose, bodies.create(
+          btRigidBody::btRigidBodyConstructionInfo(1, pose, &shape)));
+    }, boxes);
+    for (auto& box : boxes) {
+      bodies.destroy(box.second);
+      poses.destroy(static_cast<btDefaultMotionState*>(box.first));
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "usage: %s [--rate HZ] [--threads N]\n"
+                 "          [--pacing vsync|adaptive|uncapped|low-latency]\n"
+                 "          [--headless [WIDTHxHEIGHT]]\n"
+                 "          [--frames N] [--timings FILE.csv]\n"
+                 "          [--screenshot FILE.png]\n"
+                 "          [--instances matrix|transform|quantized]\n"
+                 "          [--cube indexed|arrays]\n"
+                 "          [--physics-scaling MAX_THREADS]\n"
+                 "          [--storage-benchmark BOXES] [--huge-pages]\n",
+                 argv[0]);
+    return 1;
+  }
+  // measures against the system heap (see runStorageBenchmark)
+  if (options.storageBoxes > 0)
+    return runStorageBenchmark(options);
+
+  // before Bullet allocates anything
+  PhysicsAllocator::install(options.hugePages);
+
+  if (options.physicsScaling > 0)
+    return runPhysicsScaling(options);
+  if (options.headless)
+    return runBenchmark(options);
+
+  auto logger = spdlog::stdout_logger_mt("main", true /*use color*/);
+  JobSystem jobs(options.threads);
+  World world(jobs);
+  Window window;
+  Graphics graphics(world, jobs);
+
+  world.initPhysics();
+  world.load();
+
+  {
+    // from here on, the GL context belongs to the render thread
+    RenderThread renderThread(window, graphics, options.pacing);
+
+    // track frame time and update state at a fixed timestep
+    using clock = std::chrono::high_resolution_clock;
+    const std::chrono::duration<double> timeStep(1.0 / options.stepRate);
+    auto timeCurrent = clock::now();
+    std::chrono::duration<double> timeAccum(0s);
+    auto sessionStart = timeCurrent;
+    auto lastStats = timeCurrent;
+    auto memory = PhysicsAllocator::getStats();
+
+    // game loop
+    while (true) {
+      if (window.handleEvents(graphics))
+        break;
+      auto inputTime = std::chrono::steady_clock::now();
+
+      auto now = clock::now();
+      std::chrono::duration<double> timeDelta = now - timeCurrent;
+      if (timeDelta > 0.25s)
+        timeDelta = 0.25s;
+      timeCurrent = now;
+      timeAccum += timeDelta;
+
+      // update game state
+      while (timeAccum >= timeStep) {
+        timeAccum -= timeStep;
+        world.step(timeStep.count());
+      }
+      // draw the boxes in between the last two steps, by the time left over
+      float alpha = timeAccum / timeStep;
+
+      graphics.update(timeDelta.count());
+      FramePacket& frame = renderThread.beginFrame();
+      graphics.prepareFrame(frame, window.getWidth(), window.getHeight(),
+                            alpha);
+      frame.inputTime = inputTime;
+      renderThread.submit();
+
+      if (now - lastStats >= statsInterval) {
+        logRenderStats(*logger, renderThread.getRenderStats());
+        logger->info() << "Resolution scale: "
+                       << renderThread.getResolutionScale();
+        logQueueStats(*logger, renderThread.getQueueStats());
+        lastStats = now;
+      }
+
+      // don't spin faster than the display could possibly use
+      auto elapsed = clock::now() - now;
+      if (options.pacing != FramePacer::Uncapped && elapsed < minFrameTime)
+        std::this_thread::sleep_for(minFrameTime - elapsed);
+    }
+
+    logger->info() << "Frame pacing ("
+                   << FramePacer::getModeName(options.pacing)
+                   << "): " << renderThread.getLatency() * 1000.0
+                   << " ms input latency, "
+                   << renderThread.getFrameJitter() * 1000.0
+                   << " ms frame time jitter";
+    logger->info() << "Last frame interval: "
+                   << renderThread.getSimFrameTime() * 1000.0
+                   << " ms simulation, "
+                   << renderThread.getRenderFrameTime() * 1000.0
+                   << " ms rendering";
+    logRenderStats(*logger, renderThread.getRenderStats());
+    logger->info() << "Resolution scale: "
+                   << renderThread.getResolutionScale();
+    logQueueStats(*logger, renderThread.getQueueStats());
+    logStreamStats(*logger, renderThread.getStreamStats());
+    std::chrono::duration<double> session = clock::now() - sessionStart;
+    logPhysicsMemory(*logger, memory, session.count());
   }
 
   world.save();
+  logJobStats(*logger, jobs);
 
   return 0;
 }